@@ -0,0 +1,623 @@
+// Offscreen benchmark for the techniques in smart-gamma.effect.
+//
+// Usage: smart-gamma-shader-benchmark [--frames <n>] [--effect <path>] [--output <file.json>]
+//
+// Starts libobs with the OpenGL backend on the current X11/EGL display (use scripts/run-shader-benchmark.sh to get
+// Xvfb + Mesa llvmpipe on a GPU-less box), then times every draw technique and every probe downsample chain at 1080p
+// and 4K, plus the shared probe atlas: a full atlas of tile draws per probe size and the per-frame tile reduction.
+// Results are written as JSON. Numbers from a software rasterizer are only meaningful relative to each other.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <graphics/graphics.h>
+#include <graphics/vec2.h>
+#include <graphics/vec4.h>
+#include <obs-nix-platform.h>
+#include <obs.h>
+
+#include <X11/Xlib.h>
+
+#include "smart-gamma/luminance_probe.hpp"
+#include "smart-gamma/probe_atlas.hpp"
+
+#ifndef SMART_GAMMA_EFFECT_PATH
+#define SMART_GAMMA_EFFECT_PATH "data/shaders/smart-gamma.effect"
+#endif
+
+namespace {
+
+constexpr int kDefaultFrames = 30;
+constexpr int kWarmupFrames = 3;
+
+struct Resolution {
+	const char *name;
+	uint32_t width;
+	uint32_t height;
+};
+
+constexpr Resolution kResolutions[] = {{"1080p", 1920, 1080}, {"4k", 3840, 2160}};
+
+struct DrawTechnique {
+	const char *name;
+	enum gs_color_format format;
+};
+
+// One entry per color space the filter renders in (see GetDrawTechnique in the plugin).
+constexpr DrawTechnique kDrawTechniques[] = {
+	{"Draw", GS_RGBA},
+	{"DrawLinear", GS_RGBA16F},
+	{"DrawLinearExtended", GS_RGBA16F},
+};
+
+constexpr enum gs_color_format kProbeFormats[] = {GS_RGBA, GS_RGBA16F};
+
+// Probe sizes the atlas accepts (kMinProbeSize up to kMaxAtlasProbeSize).
+constexpr uint32_t kAtlasProbeSizes[] = {8, 16, 32, 64};
+constexpr uint32_t kAtlasSize = smart_gamma::kAtlasTileSize * smart_gamma::kAtlasTilesPerRow;
+
+struct BenchmarkResult {
+	std::string kind;
+	std::string name;
+	std::string format;
+	const Resolution *resolution = nullptr;
+	uint32_t probe_size = 0;
+	std::size_t levels = 0;
+	double ms_per_frame = 0.0;
+};
+
+// Atlas cases do not depend on the source resolution.
+constexpr Resolution kAtlasResolution = {"atlas", kAtlasSize, kAtlasSize};
+
+struct Bench {
+	gs_effect_t *effect = nullptr;
+	gs_effect_t *default_effect = nullptr;
+	gs_eparam_t *image_param = nullptr;
+	gs_eparam_t *tap_offset_param = nullptr;
+	gs_texrender_t *fence = nullptr;
+	gs_stagesurf_t *fence_stage = nullptr;
+	int frames = kDefaultFrames;
+};
+
+const char *FormatName(enum gs_color_format format)
+{
+	return format == GS_RGBA16F ? "rgba16f" : "rgba8";
+}
+
+uint16_t FloatToHalf(float value)
+{
+	// Inputs are finite and in [0, 4], so only normals and zero need handling.
+	if (value <= 0.0f)
+		return 0;
+	int exponent = 0;
+	const float mantissa = std::frexp(value, &exponent);
+	const int half_exponent = exponent + 14;
+	if (half_exponent <= 0)
+		return 0;
+	const auto fraction = static_cast<uint16_t>(std::lround((mantissa * 2.0f - 1.0f) * 1024.0f));
+	return static_cast<uint16_t>((half_exponent << 10) + fraction);
+}
+
+// Gradient with some structure so the compiler cannot fold anything and highlights exceed 1.0 in the 16F case.
+gs_texture_t *CreateSourceTexture(uint32_t width, uint32_t height, enum gs_color_format format)
+{
+	const bool half = format == GS_RGBA16F;
+	const std::size_t pixel_bytes = half ? 8 : 4;
+	std::vector<uint8_t> pixels(static_cast<std::size_t>(width) * height * pixel_bytes);
+	for (uint32_t y = 0; y < height; ++y) {
+		for (uint32_t x = 0; x < width; ++x) {
+			const float u = static_cast<float>(x) / static_cast<float>(width);
+			const float v = static_cast<float>(y) / static_cast<float>(height);
+			const float rgb[3] = {u, v, 0.5f + 0.5f * std::sin((u + v) * 20.0f)};
+			uint8_t *pixel = pixels.data() + (static_cast<std::size_t>(y) * width + x) * pixel_bytes;
+			if (half) {
+				auto *channels = reinterpret_cast<uint16_t *>(pixel);
+				for (int c = 0; c < 3; ++c)
+					channels[c] = FloatToHalf(rgb[c] * (1.0f + 3.0f * u * v));
+				channels[3] = FloatToHalf(1.0f);
+			} else {
+				for (int c = 0; c < 3; ++c)
+					pixel[c] = static_cast<uint8_t>(std::lround(rgb[c] * 255.0f));
+				pixel[3] = 255;
+			}
+		}
+	}
+
+	const uint8_t *data = pixels.data();
+	return gs_texture_create(width, height, format, 1, &data, 0);
+}
+
+double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool BeginTarget(gs_texrender_t *render, uint32_t width, uint32_t height)
+{
+	gs_texrender_reset(render);
+	if (!gs_texrender_begin(render, width, height))
+		return false;
+
+	struct vec4 clear_color;
+	vec4_zero(&clear_color);
+	gs_clear(GS_CLEAR_COLOR, &clear_color, 0.0f, 0);
+	gs_ortho(0.0f, static_cast<float>(width), 0.0f, static_cast<float>(height), -100.0f, 100.0f);
+	return true;
+}
+
+// Reduces `texture` into a 1x1 target and maps it, which waits for every queued draw to finish.
+void WaitForGpu(Bench &bench, gs_texture_t *texture)
+{
+	if (!texture || !BeginTarget(bench.fence, 1, 1))
+		return;
+	gs_effect_set_texture(gs_effect_get_param_by_name(bench.default_effect, "image"), texture);
+	while (gs_effect_loop(bench.default_effect, "Draw"))
+		gs_draw_sprite(texture, 0, 1, 1);
+	gs_texrender_end(bench.fence);
+
+	gs_stage_texture(bench.fence_stage, gs_texrender_get_texture(bench.fence));
+	uint8_t *data = nullptr;
+	uint32_t linesize = 0;
+	if (gs_stagesurface_map(bench.fence_stage, &data, &linesize))
+		gs_stagesurface_unmap(bench.fence_stage);
+}
+
+void SetAdjustmentParams(gs_effect_t *effect)
+{
+	// Full strength with non-neutral settings so every adjustment step does real work.
+	gs_effect_set_float(gs_effect_get_param_by_name(effect, "effect_strength"), 1.0f);
+	gs_effect_set_float(gs_effect_get_param_by_name(effect, "gamma_adjust"), 1.6f);
+	gs_effect_set_float(gs_effect_get_param_by_name(effect, "brightness_offset"), 0.05f);
+	gs_effect_set_float(gs_effect_get_param_by_name(effect, "contrast_adjust"), 1.1f);
+	gs_effect_set_float(gs_effect_get_param_by_name(effect, "saturation_adjust"), 1.05f);
+}
+
+double BenchmarkTechnique(Bench &bench, const DrawTechnique &technique, const Resolution &resolution)
+{
+	gs_texture_t *source = CreateSourceTexture(resolution.width, resolution.height, technique.format);
+	gs_texrender_t *target = gs_texrender_create(technique.format, GS_ZS_NONE);
+	if (!source || !target) {
+		gs_texture_destroy(source);
+		gs_texrender_destroy(target);
+		return -1.0;
+	}
+
+	auto draw_frame = [&]() {
+		if (!BeginTarget(target, resolution.width, resolution.height))
+			return;
+		SetAdjustmentParams(bench.effect);
+		gs_effect_set_texture(bench.image_param, source);
+		while (gs_effect_loop(bench.effect, technique.name))
+			gs_draw_sprite(source, 0, resolution.width, resolution.height);
+		gs_texrender_end(target);
+	};
+
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+	for (int i = 0; i < kWarmupFrames; ++i)
+		draw_frame();
+	WaitForGpu(bench, gs_texrender_get_texture(target));
+
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < bench.frames; ++i)
+		draw_frame();
+	WaitForGpu(bench, gs_texrender_get_texture(target));
+	const double elapsed = MillisecondsSince(start);
+	gs_blend_state_pop();
+
+	gs_texrender_destroy(target);
+	gs_texture_destroy(source);
+	return elapsed / bench.frames;
+}
+
+// Mirrors CaptureSourceProbe: bilinear half-size copy of the source, Downsample passes, then a synchronous
+// stage + map of the probe texture. The readback is part of the real probe cost, so it is timed per frame.
+double BenchmarkProbe(Bench &bench, enum gs_color_format format, const Resolution &resolution, uint32_t size,
+		      std::size_t *level_count)
+{
+	std::array<smart_gamma::ProbeLevel, smart_gamma::kMaxProbeLevels> plan{};
+	const std::size_t count = smart_gamma::PlanProbeChain(resolution.width, resolution.height, size, plan);
+	*level_count = count;
+
+	gs_texture_t *source = CreateSourceTexture(resolution.width, resolution.height, format);
+	std::vector<gs_texrender_t *> levels(count, nullptr);
+	for (gs_texrender_t *&level : levels)
+		level = gs_texrender_create(format, GS_ZS_NONE);
+	gs_stagesurf_t *stage = gs_stagesurface_create(size, size, format);
+
+	auto release = [&]() {
+		for (gs_texrender_t *level : levels)
+			gs_texrender_destroy(level);
+		gs_stagesurface_destroy(stage);
+		gs_texture_destroy(source);
+	};
+	if (!source || !stage || std::find(levels.begin(), levels.end(), nullptr) != levels.end()) {
+		release();
+		return -1.0;
+	}
+
+	gs_eparam_t *default_image = gs_effect_get_param_by_name(bench.default_effect, "image");
+	auto probe_frame = [&]() {
+		if (BeginTarget(levels[0], plan[0].width, plan[0].height)) {
+			gs_effect_set_texture(default_image, source);
+			while (gs_effect_loop(bench.default_effect, "Draw"))
+				gs_draw_sprite(source, 0, plan[0].width, plan[0].height);
+			gs_texrender_end(levels[0]);
+		}
+		for (std::size_t i = 1; i < count; ++i) {
+			gs_texture_t *input = gs_texrender_get_texture(levels[i - 1]);
+			if (!BeginTarget(levels[i], plan[i].width, plan[i].height))
+				continue;
+			struct vec2 tap_offset;
+			vec2_set(&tap_offset, 0.25f / static_cast<float>(plan[i].width),
+				 0.25f / static_cast<float>(plan[i].height));
+			gs_effect_set_texture(bench.image_param, input);
+			gs_effect_set_vec2(bench.tap_offset_param, &tap_offset);
+			while (gs_effect_loop(bench.effect, "Downsample"))
+				gs_draw_sprite(input, 0, plan[i].width, plan[i].height);
+			gs_texrender_end(levels[i]);
+		}
+
+		gs_stage_texture(stage, gs_texrender_get_texture(levels[count - 1]));
+		uint8_t *data = nullptr;
+		uint32_t linesize = 0;
+		if (gs_stagesurface_map(stage, &data, &linesize))
+			gs_stagesurface_unmap(stage);
+	};
+
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+	const bool previous_srgb = gs_framebuffer_srgb_enabled();
+	gs_enable_framebuffer_srgb(false);
+	for (int i = 0; i < kWarmupFrames; ++i)
+		probe_frame();
+
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < bench.frames; ++i)
+		probe_frame();
+	const double elapsed = MillisecondsSince(start);
+	gs_enable_framebuffer_srgb(previous_srgb);
+	gs_blend_state_pop();
+
+	release();
+	return elapsed / bench.frames;
+}
+
+// Mirrors DrawAtlasTile for every slot, i.e. a full atlas: the probe texture is drawn into each 32x32 tile with
+// ProbeTile (8-bit probes) or ProbeTileLinear (16-bit float probes).
+double BenchmarkAtlasTiles(Bench &bench, enum gs_color_format format, uint32_t probe_size)
+{
+	gs_texture_t *probe = CreateSourceTexture(probe_size, probe_size, format);
+	gs_texrender_t *tiles = gs_texrender_create(GS_R16F, GS_ZS_NONE);
+	if (!probe || !tiles) {
+		gs_texture_destroy(probe);
+		gs_texrender_destroy(tiles);
+		return -1.0;
+	}
+
+	const char *technique = format == GS_RGBA ? "ProbeTile" : "ProbeTileLinear";
+	const auto tile = static_cast<float>(smart_gamma::kAtlasTileSize);
+	struct vec2 tap_offset;
+	vec2_zero(&tap_offset);
+	if (probe_size > smart_gamma::kAtlasTileSize)
+		vec2_set(&tap_offset, 0.25f / tile, 0.25f / tile);
+
+	const uint32_t tile_size = smart_gamma::kAtlasTileSize;
+	const uint32_t per_row = smart_gamma::kAtlasTilesPerRow;
+	auto draw_frame = [&]() {
+		if (!BeginTarget(tiles, kAtlasSize, kAtlasSize))
+			return;
+		for (int slot = 0; slot < smart_gamma::kAtlasSlotCount; ++slot) {
+			const auto index = static_cast<uint32_t>(slot);
+			gs_set_viewport(static_cast<int>((index % per_row) * tile_size),
+					static_cast<int>((index / per_row) * tile_size), static_cast<int>(tile_size),
+					static_cast<int>(tile_size));
+			gs_ortho(0.0f, tile, 0.0f, tile, -100.0f, 100.0f);
+			gs_effect_set_texture(bench.image_param, probe);
+			gs_effect_set_vec2(bench.tap_offset_param, &tap_offset);
+			while (gs_effect_loop(bench.effect, technique))
+				gs_draw_sprite(probe, 0, tile_size, tile_size);
+		}
+		gs_texrender_end(tiles);
+	};
+
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+	const bool previous_srgb = gs_framebuffer_srgb_enabled();
+	gs_enable_framebuffer_srgb(false);
+	for (int i = 0; i < kWarmupFrames; ++i)
+		draw_frame();
+	WaitForGpu(bench, gs_texrender_get_texture(tiles));
+
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < bench.frames; ++i)
+		draw_frame();
+	WaitForGpu(bench, gs_texrender_get_texture(tiles));
+	const double elapsed = MillisecondsSince(start);
+	gs_enable_framebuffer_srgb(previous_srgb);
+	gs_blend_state_pop();
+
+	gs_texrender_destroy(tiles);
+	gs_texture_destroy(probe);
+	return elapsed / bench.frames;
+}
+
+// Mirrors ReduceTiles plus the readback: the 256x256 R16F atlas through kAtlasReductionSizes down to one texel per
+// tile, then a synchronous stage + map of the 8x8 result, once per frame for all tiles together.
+double BenchmarkAtlasReduction(Bench &bench, std::size_t *level_count)
+{
+	*level_count = smart_gamma::kAtlasReductionSizes.size();
+	gs_texrender_t *tiles = gs_texrender_create(GS_R16F, GS_ZS_NONE);
+	std::array<gs_texrender_t *, smart_gamma::kAtlasReductionSizes.size()> levels{};
+	for (gs_texrender_t *&level : levels)
+		level = gs_texrender_create(GS_R16F, GS_ZS_NONE);
+	gs_stagesurf_t *stage = gs_stagesurface_create(smart_gamma::kAtlasTilesPerRow,
+						       smart_gamma::kAtlasTilesPerRow, GS_R16F);
+	// Any content will do; the reduction cost does not depend on it.
+	gs_texture_t *probe = CreateSourceTexture(kAtlasSize, kAtlasSize, GS_RGBA16F);
+
+	auto release = [&]() {
+		for (gs_texrender_t *level : levels)
+			gs_texrender_destroy(level);
+		gs_texrender_destroy(tiles);
+		gs_stagesurface_destroy(stage);
+		gs_texture_destroy(probe);
+	};
+	if (!tiles || !stage || !probe || std::find(levels.begin(), levels.end(), nullptr) != levels.end()) {
+		release();
+		return -1.0;
+	}
+
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+	const bool previous_srgb = gs_framebuffer_srgb_enabled();
+	gs_enable_framebuffer_srgb(false);
+
+	struct vec2 no_offset;
+	vec2_zero(&no_offset);
+	if (BeginTarget(tiles, kAtlasSize, kAtlasSize)) {
+		gs_effect_set_texture(bench.image_param, probe);
+		gs_effect_set_vec2(bench.tap_offset_param, &no_offset);
+		while (gs_effect_loop(bench.effect, "ProbeTileLinear"))
+			gs_draw_sprite(probe, 0, kAtlasSize, kAtlasSize);
+		gs_texrender_end(tiles);
+	}
+
+	auto reduce_frame = [&]() {
+		gs_texture_t *input = gs_texrender_get_texture(tiles);
+		for (std::size_t i = 0; input && i < levels.size(); ++i) {
+			const uint32_t size = smart_gamma::kAtlasReductionSizes[i];
+			if (!BeginTarget(levels[i], size, size)) {
+				input = nullptr;
+				break;
+			}
+			struct vec2 tap_offset;
+			vec2_set(&tap_offset, 0.25f / static_cast<float>(size), 0.25f / static_cast<float>(size));
+			gs_effect_set_texture(bench.image_param, input);
+			gs_effect_set_vec2(bench.tap_offset_param, &tap_offset);
+			while (gs_effect_loop(bench.effect, "Downsample"))
+				gs_draw_sprite(input, 0, size, size);
+			gs_texrender_end(levels[i]);
+			input = gs_texrender_get_texture(levels[i]);
+		}
+		if (!input)
+			return;
+
+		gs_stage_texture(stage, input);
+		uint8_t *data = nullptr;
+		uint32_t linesize = 0;
+		if (gs_stagesurface_map(stage, &data, &linesize))
+			gs_stagesurface_unmap(stage);
+	};
+
+	for (int i = 0; i < kWarmupFrames; ++i)
+		reduce_frame();
+
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < bench.frames; ++i)
+		reduce_frame();
+	const double elapsed = MillisecondsSince(start);
+	gs_enable_framebuffer_srgb(previous_srgb);
+	gs_blend_state_pop();
+
+	release();
+	return elapsed / bench.frames;
+}
+
+bool StartObs(Display *display)
+{
+	if (!obs_startup("en-US", nullptr, nullptr))
+		return false;
+
+	obs_set_nix_platform(OBS_NIX_PLATFORM_X11_EGL);
+	obs_set_nix_platform_display(display);
+
+	// The video thread keeps rendering the (empty) canvas; 1 fps keeps it out of the measurements.
+	struct obs_video_info ovi = {};
+	ovi.graphics_module = "libobs-opengl";
+	ovi.fps_num = 1;
+	ovi.fps_den = 1;
+	ovi.base_width = 1920;
+	ovi.base_height = 1080;
+	ovi.output_width = 1920;
+	ovi.output_height = 1080;
+	ovi.output_format = VIDEO_FORMAT_NV12;
+	ovi.adapter = 0;
+	ovi.gpu_conversion = true;
+	ovi.colorspace = VIDEO_CS_709;
+	ovi.range = VIDEO_RANGE_PARTIAL;
+	ovi.scale_type = OBS_SCALE_BICUBIC;
+	return obs_reset_video(&ovi) == OBS_VIDEO_SUCCESS;
+}
+
+std::string JsonEscape(const std::string &text)
+{
+	std::string escaped;
+	for (char c : text) {
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+		if (static_cast<unsigned char>(c) >= 0x20)
+			escaped += c;
+	}
+	return escaped;
+}
+
+void WriteJson(FILE *out, const std::string &renderer, int frames, const std::vector<BenchmarkResult> &results)
+{
+	std::fprintf(out, "{\n  \"renderer\": \"%s\",\n  \"frames\": %d,\n  \"results\": [\n",
+		     JsonEscape(renderer).c_str(), frames);
+	for (std::size_t i = 0; i < results.size(); ++i) {
+		const BenchmarkResult &result = results[i];
+		std::fprintf(out,
+			     "    {\"kind\": \"%s\", \"name\": \"%s\", \"format\": \"%s\", \"resolution\": \"%s\", "
+			     "\"width\": %u, \"height\": %u",
+			     result.kind.c_str(), result.name.c_str(), result.format.c_str(), result.resolution->name,
+			     result.resolution->width, result.resolution->height);
+		if (result.probe_size)
+			std::fprintf(out, ", \"probe_size\": %u, \"levels\": %zu", result.probe_size, result.levels);
+		std::fprintf(out, ", \"ms_per_frame\": %.4f}%s\n", result.ms_per_frame,
+			     i + 1 < results.size() ? "," : "");
+	}
+	std::fprintf(out, "  ]\n}\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	const char *effect_path = SMART_GAMMA_EFFECT_PATH;
+	const char *output_path = nullptr;
+	int frames = kDefaultFrames;
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			frames = std::max(std::atoi(argv[++i]), 1);
+		} else if (std::strcmp(argv[i], "--effect") == 0 && i + 1 < argc) {
+			effect_path = argv[++i];
+		} else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+			output_path = argv[++i];
+		} else {
+			std::fprintf(stderr, "usage: %s [--frames <n>] [--effect <path>] [--output <file.json>]\n",
+				     argv[0]);
+			return 2;
+		}
+	}
+
+	Display *display = XOpenDisplay(nullptr);
+	if (!display) {
+		std::fprintf(stderr, "no X display; run under xvfb-run (see scripts/run-shader-benchmark.sh)\n");
+		return 1;
+	}
+	if (!StartObs(display)) {
+		std::fprintf(stderr, "failed to initialise libobs with the OpenGL backend\n");
+		obs_shutdown();
+		XCloseDisplay(display);
+		return 1;
+	}
+
+	Bench bench;
+	bench.frames = frames;
+	std::vector<BenchmarkResult> results;
+	std::string renderer;
+
+	obs_enter_graphics();
+	char *errors = nullptr;
+	bench.effect = gs_effect_create_from_file(effect_path, &errors);
+	if (!bench.effect)
+		std::fprintf(stderr, "failed to load %s: %s\n", effect_path, errors ? errors : "unknown error");
+	bfree(errors);
+
+	if (bench.effect) {
+		bench.default_effect = obs_get_base_effect(OBS_EFFECT_DEFAULT);
+		bench.image_param = gs_effect_get_param_by_name(bench.effect, "image");
+		bench.tap_offset_param = gs_effect_get_param_by_name(bench.effect, "tap_offset");
+		bench.fence = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
+		bench.fence_stage = gs_stagesurface_create(1, 1, GS_RGBA);
+		renderer = gs_get_device_name();
+
+		for (const Resolution &resolution : kResolutions) {
+			for (const DrawTechnique &technique : kDrawTechniques) {
+				BenchmarkResult result;
+				result.kind = "technique";
+				result.name = technique.name;
+				result.format = FormatName(technique.format);
+				result.resolution = &resolution;
+				result.ms_per_frame = BenchmarkTechnique(bench, technique, resolution);
+				std::fprintf(stderr, "%-20s %-8s %-6s %8.3f ms\n", technique.name,
+					     result.format.c_str(), resolution.name, result.ms_per_frame);
+				results.push_back(result);
+			}
+
+			for (enum gs_color_format format : kProbeFormats) {
+				for (uint32_t size : smart_gamma::kProbeSizes) {
+					BenchmarkResult result;
+					result.kind = "probe";
+					result.name = "Downsample";
+					result.format = FormatName(format);
+					result.resolution = &resolution;
+					result.probe_size = size;
+					result.ms_per_frame =
+						BenchmarkProbe(bench, format, resolution, size, &result.levels);
+					std::fprintf(stderr, "%-20s %-8s %-6s %8.3f ms (%ux%u, %zu levels)\n",
+						     "Downsample", result.format.c_str(), resolution.name,
+						     result.ms_per_frame, size, size, result.levels);
+					results.push_back(result);
+				}
+			}
+		}
+
+		for (enum gs_color_format format : kProbeFormats) {
+			for (uint32_t size : kAtlasProbeSizes) {
+				BenchmarkResult result;
+				result.kind = "atlas_tiles";
+				result.name = format == GS_RGBA ? "ProbeTile" : "ProbeTileLinear";
+				result.format = FormatName(format);
+				result.resolution = &kAtlasResolution;
+				result.probe_size = size;
+				result.ms_per_frame = BenchmarkAtlasTiles(bench, format, size);
+				std::fprintf(stderr, "%-20s %-8s %-6s %8.3f ms (%ux%u into %d tiles)\n",
+					     result.name.c_str(), result.format.c_str(), kAtlasResolution.name,
+					     result.ms_per_frame, size, size, smart_gamma::kAtlasSlotCount);
+				results.push_back(result);
+			}
+		}
+
+		BenchmarkResult reduction;
+		reduction.kind = "atlas_reduction";
+		reduction.name = "Downsample";
+		reduction.format = "r16f";
+		reduction.resolution = &kAtlasResolution;
+		reduction.probe_size = smart_gamma::kAtlasTilesPerRow;
+		reduction.ms_per_frame = BenchmarkAtlasReduction(bench, &reduction.levels);
+		std::fprintf(stderr, "%-20s %-8s %-6s %8.3f ms (%u -> %ux%u, %zu levels)\n", "Downsample",
+			     reduction.format.c_str(), kAtlasResolution.name, reduction.ms_per_frame, kAtlasSize,
+			     smart_gamma::kAtlasTilesPerRow, smart_gamma::kAtlasTilesPerRow, reduction.levels);
+		results.push_back(reduction);
+
+		gs_stagesurface_destroy(bench.fence_stage);
+		gs_texrender_destroy(bench.fence);
+		gs_effect_destroy(bench.effect);
+	}
+	obs_leave_graphics();
+
+	obs_shutdown();
+	XCloseDisplay(display);
+	if (!bench.effect)
+		return 1;
+
+	FILE *out = output_path ? std::fopen(output_path, "w") : stdout;
+	if (!out) {
+		std::fprintf(stderr, "cannot write %s\n", output_path);
+		return 1;
+	}
+	WriteJson(out, renderer, frames, results);
+	if (out != stdout)
+		std::fclose(out);
+	return 0;
+}
@@ -0,0 +1,110 @@
+#[=======================================================================[.rst
+FindFFmpeg
+----------
+
+FindModule for the FFmpeg libraries used by the lookahead analyzer
+
+Components
+^^^^^^^^^^
+
+``avcodec``, ``avformat``, ``avutil``
+
+Imported Targets
+^^^^^^^^^^^^^^^^
+
+This module defines the :prop_tgt:`IMPORTED` target ``FFmpeg::<component>`` for every requested component that
+was found.
+
+Result Variables
+^^^^^^^^^^^^^^^^
+
+This module sets the following variables:
+
+``FFmpeg_FOUND``
+  True, if all required components were found.
+``FFmpeg_<component>_FOUND``
+  True, if the component was found.
+
+Cache variables
+^^^^^^^^^^^^^^^
+
+The following cache variables may also be set:
+
+``FFmpeg_<component>_INCLUDE_DIR``
+  Directory containing ``lib<component>/<component>.h``.
+``FFmpeg_<component>_LIBRARY``
+  Path to the component library.
+
+#]=======================================================================]
+
+include(FindPackageHandleStandardArgs)
+
+find_package(PkgConfig QUIET)
+
+if(NOT FFmpeg_FIND_COMPONENTS)
+  set(FFmpeg_FIND_COMPONENTS avcodec avformat avutil)
+endif()
+
+foreach(_component IN LISTS FFmpeg_FIND_COMPONENTS)
+  if(PKG_CONFIG_FOUND)
+    pkg_search_module(PC_FFmpeg_${_component} QUIET lib${_component})
+  endif()
+
+  find_path(
+    FFmpeg_${_component}_INCLUDE_DIR
+    NAMES lib${_component}/${_component}.h
+    HINTS ${PC_FFmpeg_${_component}_INCLUDE_DIRS}
+    PATHS /usr/include /usr/local/include
+    DOC "FFmpeg ${_component} include directory"
+  )
+
+  find_library(
+    FFmpeg_${_component}_LIBRARY
+    NAMES ${_component} lib${_component}
+    HINTS ${PC_FFmpeg_${_component}_LIBRARY_DIRS}
+    PATHS /usr/lib /usr/local/lib
+    DOC "FFmpeg ${_component} location"
+  )
+
+  if(FFmpeg_${_component}_INCLUDE_DIR AND FFmpeg_${_component}_LIBRARY)
+    set(FFmpeg_${_component}_FOUND TRUE)
+  else()
+    set(FFmpeg_${_component}_FOUND FALSE)
+  endif()
+
+  mark_as_advanced(FFmpeg_${_component}_INCLUDE_DIR FFmpeg_${_component}_LIBRARY)
+endforeach()
+
+if(CMAKE_HOST_SYSTEM_NAME MATCHES "Darwin|Windows")
+  set(FFmpeg_ERROR_REASON "Ensure that obs-deps is provided as part of CMAKE_PREFIX_PATH.")
+elseif(CMAKE_HOST_SYSTEM_NAME MATCHES "Linux|FreeBSD")
+  set(FFmpeg_ERROR_REASON "Ensure that the FFmpeg development packages are installed.")
+endif()
+
+find_package_handle_standard_args(
+  FFmpeg
+  HANDLE_COMPONENTS
+  REASON_FAILURE_MESSAGE "${FFmpeg_ERROR_REASON}"
+)
+unset(FFmpeg_ERROR_REASON)
+
+foreach(_component IN LISTS FFmpeg_FIND_COMPONENTS)
+  if(FFmpeg_${_component}_FOUND AND NOT TARGET FFmpeg::${_component})
+    add_library(FFmpeg::${_component} UNKNOWN IMPORTED)
+    set_target_properties(
+      FFmpeg::${_component}
+      PROPERTIES
+        IMPORTED_LOCATION "${FFmpeg_${_component}_LIBRARY}"
+        INTERFACE_INCLUDE_DIRECTORIES "${FFmpeg_${_component}_INCLUDE_DIR}"
+    )
+  endif()
+endforeach()
+unset(_component)
+
+include(FeatureSummary)
+set_package_properties(
+  FFmpeg
+  PROPERTIES
+    URL "https://www.ffmpeg.org"
+    DESCRIPTION "Libraries to record, convert and stream audio and video."
+)
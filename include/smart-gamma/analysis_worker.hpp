@@ -0,0 +1,24 @@
+#pragma once
+
+namespace smart_gamma {
+
+// One module-wide thread that runs the CPU side of every filter (probe reduction, smoothing, the controller) so the
+// graphics thread only renders, copies the probe readback and posts it. Filters keep their own mailbox; the worker
+// only knows which filters have something waiting.
+
+struct AnalysisTask;
+
+using AnalysisCallback = void (*)(void *data);
+
+// Starts the worker with the first registered task.
+AnalysisTask *RegisterAnalysisTask(AnalysisCallback callback, void *data);
+
+// Blocks until a running callback for the task has returned; the task is never called again afterwards. Stops the
+// worker with the last task.
+void UnregisterAnalysisTask(AnalysisTask *task);
+
+// Queues one callback run. Scheduling an already queued task is a no-op, so callbacks must drain everything that was
+// posted since their last run. Never blocks on the callback; safe to call from the graphics thread.
+void ScheduleAnalysisTask(AnalysisTask *task);
+
+} // namespace smart_gamma
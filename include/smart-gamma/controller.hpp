@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+
+#include "smart-gamma/parameter_schema.hpp"
+
+// OBS-independent part of the filter: temporal smoothing plus the two strength controllers. Shared by the plugin and
+// the offline tools so both always run the exact same code.
+
+namespace smart_gamma {
+
+inline constexpr uint32_t kProbeResolutionAuto = 0;
+inline constexpr float kLuminanceSmoothing = 0.18f;
+inline constexpr float kLuminanceSampleIntervalSeconds = 1.0f / 20.0f;
+inline constexpr float kEpsilon = 1e-4f;
+inline constexpr float kAutoStrengthResponseRate = 4.0f;
+inline constexpr float kMinAutoBrightnessThreshold = 0.01f;
+
+enum class SmartGammaMode {
+	AutoBrightness = 0,
+	ThresholdTrigger,
+};
+
+// Values are stored in trace files; append only.
+enum class SmartGammaState {
+	Idle,
+	WaitingForThreshold,
+	FadingIn,
+	Active,
+	FadingOut,
+};
+
+struct SmartGammaSettings {
+	SmartGammaMode mode = SmartGammaMode::AutoBrightness;
+	float darkness_threshold = static_cast<float>(DefaultValue(Parameter::DarknessThreshold)) / 100.0f;
+	float threshold_duration_ms = static_cast<float>(DefaultValue(Parameter::ThresholdDurationMs));
+	float fade_in_ms = static_cast<float>(DefaultValue(Parameter::FadeInMs));
+	float fade_out_ms = static_cast<float>(DefaultValue(Parameter::FadeOutMs));
+	float gamma = static_cast<float>(DefaultValue(Parameter::Gamma));
+	float brightness = static_cast<float>(DefaultValue(Parameter::Brightness));
+	float contrast = static_cast<float>(DefaultValue(Parameter::Contrast));
+	float saturation = static_cast<float>(DefaultValue(Parameter::Saturation));
+	uint32_t probe_resolution = kProbeResolutionAuto;
+};
+
+struct SmartGammaController {
+	SmartGammaState state = SmartGammaState::Idle;
+	float effect_strength = 0.0f;
+	float smoothed_luminance = 1.0f;
+	float time_below_threshold = 0.0f;
+	float time_above_threshold = 0.0f;
+};
+
+inline bool IsAutoBrightnessMode(const SmartGammaSettings &settings) noexcept
+{
+	return settings.mode == SmartGammaMode::AutoBrightness;
+}
+
+// State that matches an externally restored strength (warm start, mode switch) without resetting it.
+SmartGammaState StateForStrength(const SmartGammaController &controller, const SmartGammaSettings &settings,
+				 float strength);
+
+void UpdateThresholdStateMachine(SmartGammaController *controller, const SmartGammaSettings &settings,
+				 float delta_seconds);
+
+void UpdateAutoBrightnessStrength(SmartGammaController *controller, const SmartGammaSettings &settings,
+				  float delta_seconds);
+
+// Folds one luminance sample into the smoothed value and advances the controller for the current mode.
+void UpdateController(SmartGammaController *controller, const SmartGammaSettings &settings, float delta_seconds,
+		      float luminance);
+
+} // namespace smart_gamma
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace smart_gamma {
+
+// Timeline resolution; matches the probe rate so the controller sees the same signal either way.
+inline constexpr double kLookaheadIntervalSeconds = 1.0 / 20.0;
+
+// Auto brightness eases toward its target strength with a 0.25 s time constant (1 / kAutoStrengthResponseRate).
+// Reading the timeline that far ahead makes fades turn at the scene boundary instead of a quarter second after it.
+inline constexpr double kLookaheadLeadSeconds = 0.25;
+
+struct LookaheadAnalyzer;
+
+struct LookaheadOptions {
+	std::string file_path;
+	// Directory for cached timelines (`<hash>.sglum`); created if missing.
+	std::string cache_dir;
+};
+
+// Starts a background thread that loads the cached timeline for the file or decodes the file (reduced resolution, plane
+// averages only) into one. Never blocks on file I/O; if the file cannot be analyzed the timeline simply stays empty.
+LookaheadAnalyzer *StartLookahead(const LookaheadOptions &options);
+
+// Asks the decode thread to stop and returns without waiting for it: the thread may be inside a blocking read or the
+// cache write. The analyzer must not be used afterwards; it is freed once its thread has exited.
+void StopLookahead(LookaheadAnalyzer *analyzer);
+
+// Joins every stopped analyzer that is still winding down. Call from obs_module_unload, after all filters are gone.
+void ShutdownLookahead();
+
+const std::string &GetLookaheadFilePath(const LookaheadAnalyzer *analyzer);
+
+// Average luminance in [0, 1] around `seconds` of media time, on the GPU probe's scale (Rec.709 weights over the
+// sRGB-encoded R'G'B' of the decoded file, ignoring any filters). Lock-free; returns false while that part of the file
+// has not been analyzed yet (or analysis failed), in which case the caller falls back to the GPU probe.
+bool LookupLookaheadLuminance(const LookaheadAnalyzer *analyzer, double seconds, float *luminance);
+
+} // namespace smart_gamma
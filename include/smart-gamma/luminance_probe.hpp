@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <obs.h>
+
+namespace smart_gamma {
+
+inline constexpr uint32_t kMinProbeSize = 8;
+inline constexpr uint32_t kMaxProbeSize = 256;
+inline constexpr uint32_t kDefaultProbeSize = 32;
+inline constexpr std::size_t kMaxProbeLevels = 6;
+
+// Auto mode keeps the GPU time of the size-dependent part of the probe (the downsample levels after the first) inside
+// this budget. The first half-resolution level and the stage/map cost the same at every size, so stepping down could
+// never bring them under it.
+inline constexpr double kProbeCostBudgetMs = 0.25;
+inline constexpr uint32_t kProbesPerAutoDecision = 40;
+
+inline constexpr std::array<uint32_t, 6> kProbeSizes{{8, 16, 32, 64, 128, 256}};
+
+struct ProbeLevel {
+	uint32_t width = 0;
+	uint32_t height = 0;
+};
+
+// Tightly packed copy of the final probe level. Capturing only copies the mapped texels, so the reduction can run
+// off the graphics thread; the buffer keeps its capacity between probes.
+struct ProbeReadback {
+	std::vector<uint8_t> texels;
+	uint32_t size = 0;
+	enum gs_color_format format = GS_RGBA;
+	enum gs_color_space color_space = GS_CS_SRGB;
+};
+
+struct LuminanceProbe {
+	gs_effect_t *effect = nullptr;
+	gs_eparam_t *image_param = nullptr;
+	gs_eparam_t *tap_offset_param = nullptr;
+
+	std::array<gs_texrender_t *, kMaxProbeLevels> levels{};
+	gs_stagesurf_t *stage = nullptr;
+	uint32_t size = kDefaultProbeSize;
+	enum gs_color_format render_format = GS_UNKNOWN;
+	enum gs_color_format stage_format = GS_RGBA;
+	enum gs_color_space color_space = GS_CS_SRGB;
+
+	// Whole probe (render chain + stage/map + copy), reported in traces and stats.
+	uint64_t last_cost_ns = 0;
+	double average_cost_ms = 0.0;
+	// GPU time of the levels after the first, from a timer query read back at a later probe; drives the auto size.
+	// Stays zero where the backend has no timer queries.
+	gs_timer_range_t *chain_timer_range = nullptr;
+	gs_timer_t *chain_timer = nullptr;
+	bool chain_timer_pending = false;
+	double average_chain_cost_ms = 0.0;
+	uint32_t probes_since_auto_decision = 0;
+};
+
+// Binds the probe to the Smart Gamma effect, which provides the Downsample technique. Does not allocate GPU surfaces.
+void InitLuminanceProbe(LuminanceProbe *probe, gs_effect_t *effect);
+
+// Must be called inside a graphics context.
+void DestroyLuminanceProbe(LuminanceProbe *probe);
+
+// Plans the downsample chain from the source size to size x size. The first level halves the source so the
+// bilinear tap averages a 2x2 block, every following level reduces by up to 4x with four bilinear taps, so every
+// source texel contributes to the final probe. Returns the number of levels written to `levels`.
+std::size_t PlanProbeChain(uint32_t source_width, uint32_t source_height, uint32_t size,
+			   std::array<ProbeLevel, kMaxProbeLevels> &levels);
+
+// Picks the probe size for auto mode from the source resolution, then steps down while the GPU time of the
+// size-dependent levels exceeds kProbeCostBudgetMs (and back up once it is comfortably below it).
+uint32_t SelectAutoProbeSize(LuminanceProbe *probe, uint32_t source_width, uint32_t source_height);
+
+// Renders `target` through the downsample chain and copies the size x size result into `readback`. Linear sources
+// (SRGB_16F, 709_EXTENDED) are metered in their own format. `parent` is the filter's parent; pass nullptr to meter an
+// arbitrary source (rendered with its own filters). Must be called from the filter's video_render callback.
+bool CaptureSourceProbe(LuminanceProbe *probe, obs_source_t *target, obs_source_t *parent, uint32_t size,
+			ProbeReadback *readback);
+
+// Renders `target` through the downsample chain like CaptureSourceProbe, but leaves the size x size result on the GPU
+// (the probe atlas copies it into a tile). The texture stays valid until the probe renders again; the probe's color
+// space says how to read it. Must be called from the filter's video_render callback.
+gs_texture_t *RenderSourceProbe(LuminanceProbe *probe, obs_source_t *target, obs_source_t *parent, uint32_t size);
+
+// Same as CaptureSourceProbe for an already rendered texture in `space` (e.g. the program output). The first level is
+// a Downsample pass instead of a source render. Must be called inside a graphics context.
+bool CaptureTextureProbe(LuminanceProbe *probe, gs_texture_t *texture, enum gs_color_space space, uint32_t size,
+			 ProbeReadback *readback);
+
+// Average Rec.709 luminance of a captured probe on the sRGB-encoded scale. Linear captures are encoded with the
+// extended sRGB curve, so 1.0 is SDR white and HDR highlights read above it. Safe to call from any thread.
+float ReduceProbeReadback(const ProbeReadback &readback);
+
+// Decodes one half-float texel channel (GS_RGBA16F, GS_R16F).
+float HalfToFloat(uint16_t value);
+
+} // namespace smart_gamma
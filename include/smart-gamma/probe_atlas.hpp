@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <obs.h>
+
+namespace smart_gamma {
+
+// One render target shared by every filter that probes at the auto size. Each filter draws its final probe level into
+// its own tile; once per frame the atlas is reduced per tile on the GPU and the one-texel-per-tile result is staged
+// and read back, so the GPU synchronization per frame stays the same however many filters are metering.
+
+inline constexpr uint32_t kAtlasTileSize = 32;
+inline constexpr uint32_t kAtlasTilesPerRow = 8;
+inline constexpr uint32_t kMaxAtlasProbeSize = kAtlasTileSize * 2;
+inline constexpr int kAtlasSlotCount = 64;
+inline constexpr int kNoAtlasSlot = -1;
+
+// Per-frame reduction of the whole atlas: 256 -> 64 -> 16 -> 8 texels, so tiles shrink from 32 to 8, 2 and finally 1
+// texel. Every block a Downsample pass averages lies inside a single tile, so neighbouring tiles never bleed into each
+// other.
+inline constexpr std::array<uint32_t, 3> kAtlasReductionSizes{{64, 16, kAtlasTilesPerRow}};
+
+// Receives the tile's average luminance on the sRGB-encoded scale (same value ReduceProbeReadback gives for the
+// probe), on the graphics thread, one frame after the atlas was staged.
+using AtlasResultCallback = void (*)(void *owner, float luminance);
+
+// All functions must be called inside a graphics context, which also serializes them with the per-frame readback.
+
+// Claims a tile, creating the atlas (with the effect at `effect_path`) for the first one. Returns kNoAtlasSlot when
+// every tile is taken or the atlas cannot be created; the caller then reads its probe back on its own.
+int AcquireAtlasSlot(const char *effect_path, void *owner, AtlasResultCallback callback);
+
+// The slot's callback is never called after this returns. Frees the atlas with the last slot.
+void ReleaseAtlasSlot(int slot);
+
+// Draws a square probe level in `space` into the slot's tile. Each texel is stored as its luminance, so the per-tile
+// GPU average matches the CPU reduction. Probes from kMinProbeSize up to kMaxAtlasProbeSize fit: smaller ones are
+// replicated into the tile, larger ones averaged 2x2. The result arrives through the slot's callback.
+bool DrawAtlasTile(int slot, gs_texture_t *probe, enum gs_color_space space);
+
+} // namespace smart_gamma
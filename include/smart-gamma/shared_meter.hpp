@@ -0,0 +1,33 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace smart_gamma {
+
+// A meter is considered led while its publisher has updated it within this window (three missed probes).
+inline constexpr uint64_t kSharedMeterStaleNs = 150000000;
+
+// Latest probe result for one source, shared between the filter that probes it and any filters that use that source
+// as their sidechain. It always holds the source's own output before any of its filters, so the value does not depend
+// on who published it. Published by the analysis worker and read on the graphics thread.
+struct SharedMeter {
+	std::atomic<float> luminance{1.0f};
+	std::atomic<bool> extended_range{false};
+	std::atomic<uint64_t> updated_ns{0};
+	std::atomic<const void *> publisher{nullptr};
+};
+
+// Returns the meter for `key` (a source UUID), creating it on first use. The registry only holds weak references, so
+// a meter lives as long as some filter keeps it.
+std::shared_ptr<SharedMeter> AcquireSharedMeter(const std::string &key);
+
+void PublishSharedMeter(SharedMeter *meter, const void *publisher, float luminance, bool extended_range,
+			uint64_t now_ns);
+
+// True when someone other than `reader` keeps the meter fresh, so `reader` does not need to probe.
+bool IsSharedMeterLedByOther(const SharedMeter &meter, const void *reader, uint64_t now_ns);
+
+} // namespace smart_gamma
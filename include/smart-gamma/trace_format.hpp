@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace smart_gamma {
+
+// On-disk layout of the luminance trace files written by the recorder. Each file is a fixed-size, memory-mapped
+// TraceFileHeader followed by `capacity` TraceRecord slots of which the first `record_count` are valid. Files rotate
+// through `<prefix>-<n>.sgtrace`; `file_sequence` orders them. All fields are little-endian.
+//
+// Record timestamps come from the monotonic clock (os_gettime_ns). `created_unix_ms` and `created_monotonic_ns` are
+// read together whenever a file is (re)opened, so every file carries its own mapping from record time to wall-clock
+// time.
+
+inline constexpr char kTraceMagic[8] = {'S', 'G', 'T', 'R', 'A', 'C', 'E', '\0'};
+// Version 2 added `created_monotonic_ns`; `source_name` gave up its 8 bytes so the header stays 128 bytes.
+inline constexpr uint32_t kTraceVersion = 2;
+inline constexpr char kTraceFileExtension[] = ".sgtrace";
+
+struct TraceFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint64_t capacity;
+	uint64_t record_count;
+	uint64_t file_sequence;
+	uint64_t created_unix_ms;
+	uint64_t created_monotonic_ns;
+	char source_name[72];
+};
+
+struct TraceRecord {
+	uint64_t timestamp_ns;
+	float raw_luminance;
+	float smoothed_luminance;
+	float effect_strength;
+	uint32_t probe_cost_ns;
+	uint8_t state;
+	uint8_t mode;
+	uint16_t probe_size;
+	uint32_t reserved;
+};
+
+static_assert(sizeof(TraceFileHeader) == 128, "trace header layout is part of the file format");
+static_assert(sizeof(TraceRecord) == 32, "trace record layout is part of the file format");
+
+inline bool IsValidTraceHeader(const TraceFileHeader &header) noexcept
+{
+	return std::memcmp(header.magic, kTraceMagic, sizeof(kTraceMagic)) == 0 && header.version == kTraceVersion &&
+	       header.record_size == sizeof(TraceRecord) && header.record_count <= header.capacity;
+}
+
+// `state` holds a smart_gamma::SmartGammaState value (see controller.hpp).
+inline const char *TraceStateName(uint8_t state) noexcept
+{
+	switch (state) {
+	case 0:
+		return "idle";
+	case 1:
+		return "waiting";
+	case 2:
+		return "fading_in";
+	case 3:
+		return "active";
+	case 4:
+		return "fading_out";
+	default:
+		return "unknown";
+	}
+}
+
+} // namespace smart_gamma
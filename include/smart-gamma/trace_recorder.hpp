@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "smart-gamma/trace_format.hpp"
+
+namespace smart_gamma {
+
+struct TraceRecorder;
+
+struct TraceRecorderOptions {
+	// Files are written as `<path_prefix>-<n>.sgtrace`; the directory must exist.
+	std::string path_prefix;
+	std::string source_name;
+	// 131072 records is ~1.8 h of 20 Hz probes in a 4 MiB file; eight files cover a long stream.
+	uint64_t records_per_file = 131072;
+	uint32_t max_files = 8;
+};
+
+// Opens the first trace file and starts the background flush thread. Returns nullptr if the file cannot be mapped.
+TraceRecorder *CreateTraceRecorder(const TraceRecorderOptions &options);
+
+// Stops the flush thread after draining the queue and unmaps the current file.
+void DestroyTraceRecorder(TraceRecorder *recorder);
+
+// Lock-free and allocation-free; safe to call from the render thread. Records are dropped (and counted) if the
+// flush thread falls more than one queue length behind.
+void PushTraceRecord(TraceRecorder *recorder, const TraceRecord &record);
+
+uint64_t GetDroppedTraceRecords(const TraceRecorder *recorder);
+
+} // namespace smart_gamma
@@ -0,0 +1,25 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Runs the shader benchmark on Mesa's llvmpipe software rasterizer inside a virtual X server, so it works on CI
+# machines without a GPU. Requires xvfb-run and Mesa's EGL/GL drivers.
+
+if [[ $# -lt 1 ]]; then
+  echo "Usage: $0 <benchmark-binary> [output-json] [extra benchmark args...]" >&2
+  exit 1
+fi
+
+BENCHMARK="$1"
+OUTPUT="${2:-shader-benchmark.json}"
+shift $(( $# >= 2 ? 2 : 1 ))
+
+if [[ ! -x "$BENCHMARK" ]]; then
+  echo "Benchmark binary $BENCHMARK not found" >&2
+  exit 1
+fi
+
+export LIBGL_ALWAYS_SOFTWARE=1
+export GALLIUM_DRIVER=llvmpipe
+
+xvfb-run -a -s "-screen 0 1280x720x24" "$BENCHMARK" --output "$OUTPUT" "$@"
+echo "Wrote $OUTPUT"
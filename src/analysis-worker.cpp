@@ -0,0 +1,110 @@
+#include "smart-gamma/analysis_worker.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace smart_gamma {
+
+struct AnalysisTask {
+	AnalysisCallback callback = nullptr;
+	void *data = nullptr;
+	bool queued = false;
+	bool running = false;
+};
+
+namespace {
+
+// The lock is only held to queue and dequeue tasks, never while a callback runs.
+std::mutex worker_mutex;
+std::condition_variable worker_wake;
+std::condition_variable worker_idle;
+std::deque<AnalysisTask *> worker_queue;
+std::thread worker_thread;
+std::size_t worker_task_count = 0;
+// Bumped when the last task unregisters. A thread exits once the generation it was started for is over, so a worker
+// restarted while the previous one is still being joined never confuses the two.
+uint64_t worker_generation = 0;
+
+void WorkerLoop(uint64_t generation)
+{
+	std::unique_lock<std::mutex> lock(worker_mutex);
+	for (;;) {
+		worker_wake.wait(lock,
+				 [generation] { return worker_generation != generation || !worker_queue.empty(); });
+		if (worker_generation != generation)
+			return;
+
+		AnalysisTask *task = worker_queue.front();
+		worker_queue.pop_front();
+		task->queued = false;
+		task->running = true;
+
+		lock.unlock();
+		task->callback(task->data);
+		lock.lock();
+
+		task->running = false;
+		worker_idle.notify_all();
+	}
+}
+
+} // namespace
+
+AnalysisTask *RegisterAnalysisTask(AnalysisCallback callback, void *data)
+{
+	if (!callback)
+		return nullptr;
+
+	auto *task = new AnalysisTask();
+	task->callback = callback;
+	task->data = data;
+
+	std::lock_guard<std::mutex> lock(worker_mutex);
+	if (worker_task_count++ == 0)
+		worker_thread = std::thread(WorkerLoop, worker_generation);
+	return task;
+}
+
+void UnregisterAnalysisTask(AnalysisTask *task)
+{
+	if (!task)
+		return;
+
+	std::thread stopped_thread;
+	{
+		std::unique_lock<std::mutex> lock(worker_mutex);
+		if (task->queued)
+			worker_queue.erase(std::find(worker_queue.begin(), worker_queue.end(), task));
+		worker_idle.wait(lock, [task] { return !task->running; });
+
+		if (--worker_task_count == 0) {
+			++worker_generation;
+			stopped_thread = std::move(worker_thread);
+		}
+	}
+	worker_wake.notify_all();
+	if (stopped_thread.joinable())
+		stopped_thread.join();
+	delete task;
+}
+
+void ScheduleAnalysisTask(AnalysisTask *task)
+{
+	if (!task)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(worker_mutex);
+		if (task->queued)
+			return;
+		task->queued = true;
+		worker_queue.push_back(task);
+	}
+	worker_wake.notify_one();
+}
+
+} // namespace smart_gamma
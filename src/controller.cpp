@@ -0,0 +1,157 @@
+#include "smart-gamma/controller.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace smart_gamma {
+
+namespace {
+
+inline float clamp01(float value)
+{
+	return std::clamp(value, 0.0f, 1.0f);
+}
+
+inline float lerp(float a, float b, float t)
+{
+	return a + (b - a) * t;
+}
+
+} // namespace
+
+SmartGammaState StateForStrength(const SmartGammaController &controller, const SmartGammaSettings &settings,
+				 float strength)
+{
+	if (strength <= kEpsilon)
+		return SmartGammaState::Idle;
+	if (IsAutoBrightnessMode(settings) || strength >= 1.0f - kEpsilon)
+		return SmartGammaState::Active;
+	return controller.smoothed_luminance <= settings.darkness_threshold ? SmartGammaState::FadingIn
+									    : SmartGammaState::FadingOut;
+}
+
+void UpdateThresholdStateMachine(SmartGammaController *controller, const SmartGammaSettings &settings,
+				 float delta_seconds)
+{
+	if (!controller)
+		return;
+
+	const bool is_dark = controller->smoothed_luminance <= settings.darkness_threshold;
+
+	const float threshold_duration = std::max(settings.threshold_duration_ms / 1000.0f, 0.0f);
+	const float fade_in_seconds = std::max(settings.fade_in_ms / 1000.0f, 0.0001f);
+	const float fade_out_seconds = std::max(settings.fade_out_ms / 1000.0f, 0.0001f);
+
+	if (is_dark) {
+		controller->time_below_threshold += delta_seconds;
+		controller->time_above_threshold = 0.0f;
+	} else {
+		controller->time_above_threshold += delta_seconds;
+		controller->time_below_threshold = 0.0f;
+	}
+
+	const bool dark_duration_met = threshold_duration <= 0.0f ||
+				       controller->time_below_threshold >= threshold_duration;
+	const bool light_duration_met = threshold_duration <= 0.0f ||
+					controller->time_above_threshold >= threshold_duration;
+
+	switch (controller->state) {
+	case SmartGammaState::Idle:
+		controller->effect_strength = 0.0f;
+		if (is_dark) {
+			if (dark_duration_met) {
+				controller->state = SmartGammaState::FadingIn;
+			} else {
+				controller->state = SmartGammaState::WaitingForThreshold;
+			}
+		}
+		break;
+
+	case SmartGammaState::WaitingForThreshold:
+		if (!is_dark) {
+			controller->state = SmartGammaState::Idle;
+			controller->time_below_threshold = 0.0f;
+		} else if (dark_duration_met) {
+			controller->state = SmartGammaState::FadingIn;
+		}
+		break;
+
+	case SmartGammaState::FadingIn:
+		if (!is_dark) {
+			if (light_duration_met) {
+				controller->state = SmartGammaState::FadingOut;
+				break;
+			}
+		}
+		if (is_dark) {
+			controller->effect_strength =
+				clamp01(controller->effect_strength + (delta_seconds / fade_in_seconds));
+			if (controller->effect_strength >= 1.0f - kEpsilon) {
+				controller->effect_strength = 1.0f;
+				controller->state = SmartGammaState::Active;
+			}
+		}
+		break;
+
+	case SmartGammaState::Active:
+		controller->effect_strength = 1.0f;
+		if (!is_dark && light_duration_met)
+			controller->state = SmartGammaState::FadingOut;
+		break;
+
+	case SmartGammaState::FadingOut:
+		if (is_dark && dark_duration_met) {
+			controller->state = SmartGammaState::FadingIn;
+			break;
+		}
+		controller->effect_strength = clamp01(controller->effect_strength - (delta_seconds / fade_out_seconds));
+		if (controller->effect_strength <= kEpsilon) {
+			controller->effect_strength = 0.0f;
+			controller->state = SmartGammaState::Idle;
+		}
+		break;
+	}
+}
+
+void UpdateAutoBrightnessStrength(SmartGammaController *controller, const SmartGammaSettings &settings,
+				  float delta_seconds)
+{
+	if (!controller)
+		return;
+
+	controller->time_above_threshold = 0.0f;
+	controller->time_below_threshold = 0.0f;
+
+	const float threshold = std::max(settings.darkness_threshold, kMinAutoBrightnessThreshold);
+	float target_strength = 0.0f;
+	if (controller->smoothed_luminance < threshold)
+		target_strength = clamp01(1.0f - (controller->smoothed_luminance / threshold));
+
+	const float response = 1.0f - std::exp(-delta_seconds * kAutoStrengthResponseRate);
+	controller->effect_strength = lerp(controller->effect_strength, target_strength, clamp01(response));
+
+	if (controller->effect_strength <= kEpsilon && target_strength <= kEpsilon) {
+		controller->state = SmartGammaState::Idle;
+	} else {
+		controller->state = SmartGammaState::Active;
+	}
+}
+
+void UpdateController(SmartGammaController *controller, const SmartGammaSettings &settings, float delta_seconds,
+		      float luminance)
+{
+	if (!controller)
+		return;
+
+	if (delta_seconds <= 0.0f)
+		delta_seconds = 1.0f / 60.0f;
+
+	controller->smoothed_luminance = lerp(controller->smoothed_luminance, luminance, clamp01(kLuminanceSmoothing));
+
+	if (IsAutoBrightnessMode(settings))
+		UpdateAutoBrightnessStrength(controller, settings, delta_seconds);
+	else
+		UpdateThresholdStateMachine(controller, settings, delta_seconds);
+}
+
+} // namespace smart_gamma
@@ -0,0 +1,527 @@
+#include "smart-gamma/lookahead.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include <obs-module.h>
+#include <util/platform.h>
+
+namespace smart_gamma {
+
+namespace {
+
+constexpr char kTimelineMagic[8] = {'S', 'G', 'L', 'U', 'M', 'A', '\0', '\0'};
+// Version 2 stores Rec.709 luminance of the decoded R'G'B' instead of raw Y'.
+constexpr uint32_t kTimelineVersion = 2;
+constexpr char kTimelineExtension[] = ".sglum";
+
+// Bytes hashed from each end of the file; together with size and mtime this identifies a file without reading it.
+constexpr std::size_t kHashSampleBytes = 64 * 1024;
+// Every 4th pixel of every 4th row is plenty for an average and keeps 4K luma planes cheap.
+constexpr int kLumaSampleStep = 4;
+// Reject files that would need an absurd timeline (over ~14 days at 20 Hz).
+constexpr double kMaxDurationSeconds = 14.0 * 24.0 * 3600.0;
+
+struct TimelineHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t interval_us;
+	uint64_t count;
+};
+
+static_assert(sizeof(TimelineHeader) == 24, "timeline header layout is part of the cache format");
+
+uint64_t HashBytes(uint64_t hash, const void *data, std::size_t size)
+{
+	// FNV-1a, 64-bit.
+	const auto *bytes = static_cast<const uint8_t *>(data);
+	for (std::size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+bool HashFile(const std::string &path, uint64_t *hash)
+{
+	struct stat info;
+	if (os_stat(path.c_str(), &info) != 0)
+		return false;
+
+	FILE *file = os_fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	const auto size = static_cast<uint64_t>(info.st_size);
+	const auto mtime = static_cast<int64_t>(info.st_mtime);
+	uint64_t result = 14695981039346656037ull;
+	result = HashBytes(result, &size, sizeof(size));
+	result = HashBytes(result, &mtime, sizeof(mtime));
+
+	std::vector<uint8_t> buffer(kHashSampleBytes);
+	std::size_t read = std::fread(buffer.data(), 1, buffer.size(), file);
+	result = HashBytes(result, buffer.data(), read);
+	const auto tail_offset = static_cast<int64_t>(size - kHashSampleBytes);
+	if (size > kHashSampleBytes && os_fseeki64(file, tail_offset, SEEK_SET) == 0) {
+		read = std::fread(buffer.data(), 1, buffer.size(), file);
+		result = HashBytes(result, buffer.data(), read);
+	}
+	std::fclose(file);
+
+	*hash = result;
+	return true;
+}
+
+} // namespace
+
+struct LookaheadAnalyzer {
+	std::string file_path;
+	std::string cache_path;
+
+	// Sized once by the analyze thread before anything is published; entries below `ready_count` are final.
+	std::vector<float> timeline;
+	std::atomic<std::size_t> ready_count{0};
+
+	std::atomic<bool> stopping{false};
+	// Set as the analyze thread's last action, so joining it afterwards never waits.
+	std::atomic<bool> finished{false};
+	std::thread analyze_thread;
+};
+
+namespace {
+
+bool LoadTimeline(LookaheadAnalyzer *analyzer)
+{
+	FILE *file = os_fopen(analyzer->cache_path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	TimelineHeader header = {};
+	bool ok = std::fread(&header, sizeof(header), 1, file) == 1 &&
+		  std::memcmp(header.magic, kTimelineMagic, sizeof(kTimelineMagic)) == 0 &&
+		  header.version == kTimelineVersion &&
+		  header.interval_us == static_cast<uint32_t>(std::lround(kLookaheadIntervalSeconds * 1e6)) &&
+		  header.count > 0 && header.count <= kMaxDurationSeconds / kLookaheadIntervalSeconds;
+	if (ok) {
+		analyzer->timeline.resize(static_cast<std::size_t>(header.count));
+		ok = std::fread(analyzer->timeline.data(), sizeof(float), analyzer->timeline.size(), file) ==
+		     analyzer->timeline.size();
+	}
+	std::fclose(file);
+
+	if (!ok) {
+		analyzer->timeline.clear();
+		return false;
+	}
+	analyzer->ready_count.store(analyzer->timeline.size(), std::memory_order_release);
+	return true;
+}
+
+void SaveTimeline(const LookaheadAnalyzer *analyzer)
+{
+	if (analyzer->cache_path.empty())
+		return;
+
+	// Write to a temporary name first so a crash never leaves a truncated cache entry behind.
+	const std::string temp_path = analyzer->cache_path + ".tmp";
+	FILE *file = os_fopen(temp_path.c_str(), "wb");
+	if (!file)
+		return;
+
+	TimelineHeader header = {};
+	std::memcpy(header.magic, kTimelineMagic, sizeof(kTimelineMagic));
+	header.version = kTimelineVersion;
+	header.interval_us = static_cast<uint32_t>(std::lround(kLookaheadIntervalSeconds * 1e6));
+	header.count = analyzer->timeline.size();
+	const bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+			std::fwrite(analyzer->timeline.data(), sizeof(float), analyzer->timeline.size(), file) ==
+				analyzer->timeline.size();
+	std::fclose(file);
+
+	if (!ok || os_safe_replace(analyzer->cache_path.c_str(), temp_path.c_str(), nullptr) != 0)
+		os_unlink(temp_path.c_str());
+}
+
+// Mean code value of one component over every kLumaSampleStep-th sample of every kLumaSampleStep-th row, or a negative
+// value when the plane is empty. Chroma planes are subsampled as the pixel format says.
+double AverageComponent(const AVFrame *frame, const AVPixFmtDescriptor *desc, int index)
+{
+	const AVComponentDescriptor &comp = desc->comp[index];
+	const bool chroma = index == 1 || index == 2;
+	const int width = chroma ? (frame->width + (1 << desc->log2_chroma_w) - 1) >> desc->log2_chroma_w
+				 : frame->width;
+	const int height = chroma ? (frame->height + (1 << desc->log2_chroma_h) - 1) >> desc->log2_chroma_h
+				  : frame->height;
+	const uint8_t *plane = frame->data[comp.plane];
+	const int linesize = frame->linesize[comp.plane];
+	const bool wide = comp.depth > 8;
+
+	double sum = 0.0;
+	uint64_t count = 0;
+	for (int y = 0; y < height; y += kLumaSampleStep) {
+		const uint8_t *row = plane + static_cast<std::ptrdiff_t>(y) * linesize + comp.offset;
+		for (int x = 0; x < width; x += kLumaSampleStep) {
+			const uint8_t *sample = row + static_cast<std::ptrdiff_t>(x) * comp.step;
+			uint32_t value = 0;
+			if (wide) {
+				uint16_t word;
+				std::memcpy(&word, sample, sizeof(word));
+				value = word;
+			} else {
+				value = *sample;
+			}
+			sum += static_cast<double>(value >> comp.shift);
+			++count;
+		}
+	}
+	return count > 0 ? sum / static_cast<double>(count) : -1.0;
+}
+
+// Kr and Kb of the file's YCbCr matrix; unspecified files are decoded as BT.709, like the Media Source does.
+void GetMatrixCoefficients(enum AVColorSpace space, double *kr, double *kb)
+{
+	switch (space) {
+	case AVCOL_SPC_BT470BG:
+	case AVCOL_SPC_SMPTE170M:
+	case AVCOL_SPC_FCC:
+		*kr = 0.299;
+		*kb = 0.114;
+		break;
+	case AVCOL_SPC_BT2020_NCL:
+	case AVCOL_SPC_BT2020_CL:
+		*kr = 0.2627;
+		*kb = 0.0593;
+		break;
+	default:
+		*kr = 0.2126;
+		*kb = 0.0722;
+		break;
+	}
+}
+
+// Mean luminance of one decoded frame on the GPU probe's scale: Rec.709 weights over the sRGB-encoded R'G'B' the
+// source renders, in [0, 1]. YCbCr -> R'G'B' is linear, so it is applied to the plane means rather than per pixel
+// (only the clipping of out-of-gamut pixels is lost). Returns a negative value for formats without a luma plane.
+float AverageLuminance(const AVFrame *frame)
+{
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(static_cast<enum AVPixelFormat>(frame->format));
+	if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL)) || desc->nb_components < 1)
+		return -1.0f;
+
+	const double luma = AverageComponent(frame, desc, 0);
+	if (luma < 0.0)
+		return -1.0f;
+
+	const int depth = desc->comp[0].depth;
+	const double scale = static_cast<double>(1u << (depth - 8));
+	const double max_code = static_cast<double>((1u << depth) - 1);
+	const bool full_range = frame->color_range == AVCOL_RANGE_JPEG;
+	const double y = full_range ? luma / max_code : (luma - 16.0 * scale) / (219.0 * scale);
+
+	// Grey formats have no chroma: Y' is already the encoded luminance.
+	double luminance = y;
+	if (desc->nb_components >= 3) {
+		const double cb_mean = AverageComponent(frame, desc, 1);
+		const double cr_mean = AverageComponent(frame, desc, 2);
+		if (cb_mean >= 0.0 && cr_mean >= 0.0) {
+			const double chroma_scale = full_range ? max_code : 224.0 * scale;
+			const double cb = (cb_mean - 128.0 * scale) / chroma_scale;
+			const double cr = (cr_mean - 128.0 * scale) / chroma_scale;
+
+			double kr = 0.0;
+			double kb = 0.0;
+			GetMatrixCoefficients(frame->colorspace, &kr, &kb);
+			const double r = y + 2.0 * (1.0 - kr) * cr;
+			const double b = y + 2.0 * (1.0 - kb) * cb;
+			const double g = (y - kr * r - kb * b) / (1.0 - kr - kb);
+			luminance = 0.2126 * r + 0.7152 * g + 0.0722 * b;
+		}
+	}
+	return static_cast<float>(std::clamp(luminance, 0.0, 1.0));
+}
+
+class DecodeSession {
+public:
+	~DecodeSession()
+	{
+		av_frame_free(&frame);
+		av_packet_free(&packet);
+		avcodec_free_context(&codec);
+		avformat_close_input(&format);
+	}
+
+	bool Open(const std::string &path, const std::atomic<bool> *stopping)
+	{
+		// Probing can take a while on large files; let StopLookahead interrupt it.
+		format = avformat_alloc_context();
+		if (!format)
+			return false;
+		format->interrupt_callback.callback = [](void *opaque) {
+			return static_cast<const std::atomic<bool> *>(opaque)->load(std::memory_order_relaxed) ? 1 : 0;
+		};
+		format->interrupt_callback.opaque = const_cast<std::atomic<bool> *>(stopping);
+		if (avformat_open_input(&format, path.c_str(), nullptr, nullptr) < 0 ||
+		    avformat_find_stream_info(format, nullptr) < 0)
+			return false;
+
+		const AVCodec *decoder = nullptr;
+		stream_index = av_find_best_stream(format, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+		if (stream_index < 0 || !decoder)
+			return false;
+
+		const AVStream *stream = format->streams[stream_index];
+		codec = avcodec_alloc_context3(decoder);
+		if (!codec || avcodec_parameters_to_context(codec, stream->codecpar) < 0)
+			return false;
+
+		// Only plane averages matter: decode at reduced resolution where the codec allows it, skip the
+		// loop filter and non-reference frames, and leave most cores to OBS.
+		codec->lowres = std::min(2, static_cast<int>(decoder->max_lowres));
+		codec->skip_loop_filter = AVDISCARD_ALL;
+		codec->skip_frame = AVDISCARD_NONREF;
+		codec->thread_count = 2;
+		if (avcodec_open2(codec, decoder, nullptr) < 0)
+			return false;
+
+		// PQ/HLG luma is not on the SDR scale the controller works in; leave those files to the GPU probe.
+		if (codec->color_trc == AVCOL_TRC_SMPTE2084 || codec->color_trc == AVCOL_TRC_ARIB_STD_B67)
+			return false;
+
+		time_base = av_q2d(stream->time_base);
+		start_seconds = stream->start_time != AV_NOPTS_VALUE ? stream->start_time * time_base : 0.0;
+		if (format->duration > 0)
+			duration_seconds = static_cast<double>(format->duration) / AV_TIME_BASE;
+		else if (stream->duration > 0)
+			duration_seconds = stream->duration * time_base;
+
+		packet = av_packet_alloc();
+		frame = av_frame_alloc();
+		return packet && frame && duration_seconds > 0.0 && duration_seconds <= kMaxDurationSeconds;
+	}
+
+	AVFormatContext *format = nullptr;
+	AVCodecContext *codec = nullptr;
+	AVPacket *packet = nullptr;
+	AVFrame *frame = nullptr;
+	int stream_index = -1;
+	double time_base = 0.0;
+	double start_seconds = 0.0;
+	double duration_seconds = 0.0;
+};
+
+// Accumulates frames into timeline buckets. Buckets are published in order once decoding has moved past them;
+// buckets that received no frame (skipped non-reference frames, variable frame rate) repeat the previous value.
+class TimelineBuilder {
+public:
+	explicit TimelineBuilder(LookaheadAnalyzer *analyzer) : analyzer(analyzer) {}
+
+	void Add(double seconds, float luma)
+	{
+		const auto bucket = static_cast<std::size_t>(std::max(seconds, 0.0) / kLookaheadIntervalSeconds);
+		if (bucket >= analyzer->timeline.size())
+			return;
+		if (bucket != current_bucket) {
+			Flush(bucket);
+			current_bucket = bucket;
+		}
+		sum += luma;
+		++count;
+	}
+
+	void Finish() { Flush(analyzer->timeline.size()); }
+
+private:
+	void Flush(std::size_t next_bucket)
+	{
+		std::size_t ready = analyzer->ready_count.load(std::memory_order_relaxed);
+		if (count > 0 && current_bucket >= ready) {
+			// Fill any gap up to this bucket with the last published value, then publish it.
+			for (; ready < current_bucket; ++ready)
+				analyzer->timeline[ready] = last_value;
+			last_value = static_cast<float>(sum / count);
+			analyzer->timeline[ready++] = last_value;
+		}
+		if (next_bucket == analyzer->timeline.size()) {
+			for (; ready < next_bucket; ++ready)
+				analyzer->timeline[ready] = last_value;
+		}
+		analyzer->ready_count.store(ready, std::memory_order_release);
+		sum = 0.0;
+		count = 0;
+	}
+
+	LookaheadAnalyzer *analyzer;
+	std::size_t current_bucket = 0;
+	double sum = 0.0;
+	uint32_t count = 0;
+	float last_value = 0.0f;
+};
+
+void DecodeFile(LookaheadAnalyzer *analyzer, DecodeSession *session)
+{
+	const uint64_t start_ns = os_gettime_ns();
+	TimelineBuilder builder(analyzer);
+	bool failed = false;
+
+	auto drain_frames = [&]() {
+		while (avcodec_receive_frame(session->codec, session->frame) == 0) {
+			const int64_t pts = session->frame->best_effort_timestamp;
+			const float luminance = AverageLuminance(session->frame);
+			av_frame_unref(session->frame);
+			if (luminance < 0.0f) {
+				failed = true;
+				return;
+			}
+			if (pts != AV_NOPTS_VALUE)
+				builder.Add(pts * session->time_base - session->start_seconds, luminance);
+		}
+	};
+
+	while (!failed && !analyzer->stopping.load(std::memory_order_relaxed) &&
+	       av_read_frame(session->format, session->packet) >= 0) {
+		if (session->packet->stream_index == session->stream_index &&
+		    avcodec_send_packet(session->codec, session->packet) >= 0)
+			drain_frames();
+		av_packet_unref(session->packet);
+	}
+
+	if (failed || analyzer->stopping.load(std::memory_order_relaxed)) {
+		if (failed)
+			blog(LOG_INFO, "Smart Gamma: lookahead does not support the pixel format of %s",
+			     analyzer->file_path.c_str());
+		return;
+	}
+
+	avcodec_send_packet(session->codec, nullptr);
+	drain_frames();
+	builder.Finish();
+	SaveTimeline(analyzer);
+	blog(LOG_INFO, "Smart Gamma: analyzed %s (%.0f s) in %.1f s", analyzer->file_path.c_str(),
+	     static_cast<double>(analyzer->timeline.size()) * kLookaheadIntervalSeconds,
+	     static_cast<double>(os_gettime_ns() - start_ns) / 1e9);
+}
+
+// Runs entirely off the video thread: hashing, probing and opening a file can each take noticeable time.
+void AnalyzeFile(LookaheadAnalyzer *analyzer, const std::string &cache_dir)
+{
+	uint64_t hash = 0;
+	if (!HashFile(analyzer->file_path, &hash))
+		return;
+
+	if (!cache_dir.empty() && os_mkdirs(cache_dir.c_str()) != MKDIR_ERROR) {
+		char name[32];
+		std::snprintf(name, sizeof(name), "%016llx%s", static_cast<unsigned long long>(hash),
+			      kTimelineExtension);
+		analyzer->cache_path = cache_dir + "/" + name;
+		if (LoadTimeline(analyzer))
+			return;
+	}
+
+	DecodeSession session;
+	if (!session.Open(analyzer->file_path, &analyzer->stopping)) {
+		if (!analyzer->stopping.load(std::memory_order_relaxed))
+			blog(LOG_INFO, "Smart Gamma: lookahead cannot analyze %s; using the GPU probe",
+			     analyzer->file_path.c_str());
+		return;
+	}
+
+	analyzer->timeline.assign(
+		static_cast<std::size_t>(std::ceil(session.duration_seconds / kLookaheadIntervalSeconds)) + 1, 0.0f);
+	DecodeFile(analyzer, &session);
+}
+
+void AnalyzeThread(LookaheadAnalyzer *analyzer, std::string cache_dir)
+{
+	AnalyzeFile(analyzer, cache_dir);
+	analyzer->finished.store(true, std::memory_order_release);
+}
+
+// Stopped analyzers whose thread may still be inside a blocking read, the hash or the cache write. They are joined once
+// finished (checked on every stop) or at module unload, never while the caller waits.
+std::mutex retired_mutex;
+std::vector<LookaheadAnalyzer *> retired_analyzers;
+
+void ReapRetiredAnalyzers(bool wait)
+{
+	std::vector<LookaheadAnalyzer *> reaped;
+	{
+		std::lock_guard<std::mutex> lock(retired_mutex);
+		auto still_running = [wait](const LookaheadAnalyzer *analyzer) {
+			return !wait && !analyzer->finished.load(std::memory_order_acquire);
+		};
+		auto done = std::stable_partition(retired_analyzers.begin(), retired_analyzers.end(), still_running);
+		reaped.assign(done, retired_analyzers.end());
+		retired_analyzers.erase(done, retired_analyzers.end());
+	}
+
+	for (LookaheadAnalyzer *analyzer : reaped) {
+		if (analyzer->analyze_thread.joinable())
+			analyzer->analyze_thread.join();
+		delete analyzer;
+	}
+}
+
+} // namespace
+
+LookaheadAnalyzer *StartLookahead(const LookaheadOptions &options)
+{
+	if (options.file_path.empty())
+		return nullptr;
+
+	auto *analyzer = new LookaheadAnalyzer();
+	analyzer->file_path = options.file_path;
+	analyzer->analyze_thread = std::thread(AnalyzeThread, analyzer, options.cache_dir);
+	return analyzer;
+}
+
+void StopLookahead(LookaheadAnalyzer *analyzer)
+{
+	if (!analyzer)
+		return;
+
+	analyzer->stopping.store(true, std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lock(retired_mutex);
+		retired_analyzers.push_back(analyzer);
+	}
+	ReapRetiredAnalyzers(false);
+}
+
+void ShutdownLookahead()
+{
+	ReapRetiredAnalyzers(true);
+}
+
+const std::string &GetLookaheadFilePath(const LookaheadAnalyzer *analyzer)
+{
+	return analyzer->file_path;
+}
+
+bool LookupLookaheadLuminance(const LookaheadAnalyzer *analyzer, double seconds, float *luminance)
+{
+	if (!analyzer || !luminance || seconds < 0.0)
+		return false;
+
+	const auto index = static_cast<std::size_t>(seconds / kLookaheadIntervalSeconds);
+	if (index >= analyzer->ready_count.load(std::memory_order_acquire))
+		return false;
+
+	*luminance = analyzer->timeline[index];
+	return true;
+}
+
+} // namespace smart_gamma
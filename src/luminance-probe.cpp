@@ -0,0 +1,539 @@
+#include "smart-gamma/luminance_probe.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <graphics/graphics.h>
+#include <graphics/vec2.h>
+#include <graphics/vec4.h>
+#include <util/platform.h>
+
+namespace smart_gamma {
+
+namespace {
+
+constexpr double kProbeCostSmoothing = 0.1;
+
+// Extended sRGB encode (no upper clamp) so linear-light readbacks land on the same scale as SDR ones.
+float LinearToSrgb(float value)
+{
+	if (value <= 0.0031308f)
+		return std::max(value, 0.0f) * 12.92f;
+	return 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+bool IsHdrFormat(enum gs_color_format format)
+{
+	return format == GS_RGBA16F;
+}
+
+bool IsBgraFormat(enum gs_color_format format)
+{
+	switch (format) {
+	case GS_BGRA:
+	case GS_BGRX:
+	case GS_BGRA_UNORM:
+	case GS_BGRX_UNORM:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool IsRgbaFormat(enum gs_color_format format)
+{
+	switch (format) {
+	case GS_RGBA:
+	case GS_RGBA_UNORM:
+		return true;
+	default:
+		return false;
+	}
+}
+
+uint32_t GetPixelStride(enum gs_color_format format)
+{
+	return IsHdrFormat(format) ? 8u : 4u;
+}
+
+uint32_t PreferredProbeSize(uint32_t source_width, uint32_t source_height)
+{
+	// Every source texel is averaged by the chain regardless of the final size, so larger sources only get a
+	// larger probe to save a downsample pass.
+	const uint32_t max_dimension = std::max(source_width, source_height);
+	if (max_dimension == 0)
+		return kDefaultProbeSize;
+	if (max_dimension <= 1280)
+		return 16;
+	if (max_dimension <= 2560)
+		return 32;
+	return 64;
+}
+
+void DestroyProbeLevels(LuminanceProbe *probe)
+{
+	for (gs_texrender_t *&level : probe->levels) {
+		if (level) {
+			gs_texrender_destroy(level);
+			level = nullptr;
+		}
+	}
+}
+
+void DestroyChainTimer(LuminanceProbe *probe)
+{
+	if (probe->chain_timer) {
+		gs_timer_destroy(probe->chain_timer);
+		probe->chain_timer = nullptr;
+	}
+	if (probe->chain_timer_range) {
+		gs_timer_range_destroy(probe->chain_timer_range);
+		probe->chain_timer_range = nullptr;
+	}
+	probe->chain_timer_pending = false;
+}
+
+void DestroyProbeStage(LuminanceProbe *probe)
+{
+	if (probe->stage) {
+		gs_stagesurface_destroy(probe->stage);
+		probe->stage = nullptr;
+	}
+}
+
+void SetProbeTarget(LuminanceProbe *probe, enum gs_color_format format, uint32_t size)
+{
+	if (probe->render_format == format && probe->size == size)
+		return;
+
+	if (probe->render_format != format)
+		DestroyProbeLevels(probe);
+	DestroyProbeStage(probe);
+
+	if (probe->size != size) {
+		probe->average_cost_ms = 0.0;
+		probe->average_chain_cost_ms = 0.0;
+		// A query still in flight timed the old size.
+		probe->chain_timer_pending = false;
+		probe->probes_since_auto_decision = 0;
+	}
+
+	probe->render_format = format;
+	probe->size = size;
+}
+
+// Only the per-filter readback needs a stage; atlas probes leave it unallocated.
+bool EnsureProbeStage(LuminanceProbe *probe)
+{
+	if (probe->stage)
+		return true;
+
+	probe->stage = gs_stagesurface_create(probe->size, probe->size, gs_generalize_format(probe->render_format));
+	if (!probe->stage) {
+		probe->stage_format = GS_RGBA;
+		return false;
+	}
+
+	probe->stage_format = gs_stagesurface_get_color_format(probe->stage);
+	return true;
+}
+
+bool EnsureProbeLevels(LuminanceProbe *probe, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; ++i) {
+		if (!probe->levels[i])
+			probe->levels[i] = gs_texrender_create(probe->render_format, GS_ZS_NONE);
+		if (!probe->levels[i])
+			return false;
+	}
+	return true;
+}
+
+bool BeginProbeLevel(gs_texrender_t *render, const ProbeLevel &level, enum gs_color_space space)
+{
+	gs_texrender_reset(render);
+	if (!gs_texrender_begin_with_color_space(render, level.width, level.height, space))
+		return false;
+
+	struct vec4 clear_color;
+	vec4_zero(&clear_color);
+	gs_clear(GS_CLEAR_COLOR, &clear_color, 0.0f, 0);
+	gs_ortho(0.0f, static_cast<float>(level.width), 0.0f, static_cast<float>(level.height), -100.0f, 100.0f);
+	return true;
+}
+
+bool RenderSourceLevel(gs_texrender_t *render, const ProbeLevel &level, obs_source_t *target, obs_source_t *parent,
+		       enum gs_color_space space, uint32_t source_width, uint32_t source_height)
+{
+	if (!BeginProbeLevel(render, level, space))
+		return false;
+
+	const uint32_t parent_flags = obs_source_get_output_flags(target);
+	const bool custom_draw = (parent_flags & OBS_SOURCE_CUSTOM_DRAW) != 0;
+	const bool async = (parent_flags & OBS_SOURCE_ASYNC) != 0;
+
+	gs_matrix_push();
+	gs_matrix_identity();
+	const float scale_x = static_cast<float>(level.width) / static_cast<float>(source_width);
+	const float scale_y = static_cast<float>(level.height) / static_cast<float>(source_height);
+	gs_matrix_scale3f(scale_x, scale_y, 1.0f);
+
+	if (target == parent && !custom_draw && !async)
+		obs_source_default_render(target);
+	else
+		obs_source_video_render(target);
+
+	gs_matrix_pop();
+	gs_texrender_end(render);
+	return true;
+}
+
+// Averages raw texel values, so the framebuffer sRGB conversion is disabled for the pass.
+bool RenderDownsampleLevel(LuminanceProbe *probe, gs_texture_t *input, gs_texrender_t *render, const ProbeLevel &level,
+			   enum gs_color_space space)
+{
+	if (!input || !BeginProbeLevel(render, level, space))
+		return false;
+
+	const bool previous_srgb = gs_framebuffer_srgb_enabled();
+	gs_enable_framebuffer_srgb(false);
+
+	// Four bilinear taps a quarter output texel from the centre cover the whole 4x4 input footprint (2x2 when the
+	// level halves its input).
+	struct vec2 tap_offset;
+	vec2_set(&tap_offset, 0.25f / static_cast<float>(level.width), 0.25f / static_cast<float>(level.height));
+	gs_effect_set_texture(probe->image_param, input);
+	gs_effect_set_vec2(probe->tap_offset_param, &tap_offset);
+	while (gs_effect_loop(probe->effect, "Downsample"))
+		gs_draw_sprite(input, 0, level.width, level.height);
+
+	gs_enable_framebuffer_srgb(previous_srgb);
+	gs_texrender_end(render);
+	return true;
+}
+
+float ReduceStagedLuminance(const uint8_t *data, uint32_t linesize, uint32_t size, enum gs_color_format format)
+{
+	const bool hdr_format = IsHdrFormat(format);
+	const bool bgra_format = IsBgraFormat(format);
+	const bool rgba_format = IsRgbaFormat(format);
+	const uint32_t pixel_stride = GetPixelStride(format);
+	const double ldr_scale = 1.0 / 255.0;
+	double accum = 0.0;
+	for (uint32_t y = 0; y < size; ++y) {
+		const uint8_t *row = data + (static_cast<size_t>(y) * linesize);
+		for (uint32_t x = 0; x < size; ++x) {
+			const uint8_t *pixel = row + static_cast<size_t>(x) * pixel_stride;
+			float r = 0.0f;
+			float g = 0.0f;
+			float b = 0.0f;
+			if (hdr_format) {
+				// Linear light: take the texel's luminance first, then encode it without clamping.
+				const auto *channels = reinterpret_cast<const uint16_t *>(pixel);
+				const float linear = 0.2126f * HalfToFloat(channels[0]) +
+						     0.7152f * HalfToFloat(channels[1]) +
+						     0.0722f * HalfToFloat(channels[2]);
+				accum += std::isfinite(linear) ? LinearToSrgb(linear) : 0.0f;
+				continue;
+			} else if (bgra_format) {
+				r = static_cast<float>(pixel[2]) * static_cast<float>(ldr_scale);
+				g = static_cast<float>(pixel[1]) * static_cast<float>(ldr_scale);
+				b = static_cast<float>(pixel[0]) * static_cast<float>(ldr_scale);
+			} else if (rgba_format) {
+				r = static_cast<float>(pixel[0]) * static_cast<float>(ldr_scale);
+				g = static_cast<float>(pixel[1]) * static_cast<float>(ldr_scale);
+				b = static_cast<float>(pixel[2]) * static_cast<float>(ldr_scale);
+			} else {
+				// Fallback: assume first three channels are RGB order
+				r = static_cast<float>(pixel[0]) * static_cast<float>(ldr_scale);
+				g = static_cast<float>(pixel[1]) * static_cast<float>(ldr_scale);
+				b = static_cast<float>(pixel[2]) * static_cast<float>(ldr_scale);
+			}
+			accum += 0.2126 * r + 0.7152 * g + 0.0722 * b;
+		}
+	}
+	const double count = static_cast<double>(size) * static_cast<double>(size);
+	return static_cast<float>(accum / std::max(count, 1.0));
+}
+
+bool CopyReadback(LuminanceProbe *probe, gs_texture_t *texture, ProbeReadback *readback)
+{
+	if (!texture)
+		return false;
+
+	gs_stage_texture(probe->stage, texture);
+	gs_flush();
+	uint8_t *data = nullptr;
+	uint32_t linesize = 0;
+	if (!gs_stagesurface_map(probe->stage, &data, &linesize))
+		return false;
+
+	const std::size_t row_bytes = static_cast<std::size_t>(probe->size) * GetPixelStride(probe->stage_format);
+	readback->texels.resize(row_bytes * probe->size);
+	for (uint32_t y = 0; y < probe->size; ++y)
+		std::memcpy(readback->texels.data() + y * row_bytes, data + static_cast<std::size_t>(y) * linesize,
+			    row_bytes);
+	gs_stagesurface_unmap(probe->stage);
+
+	readback->size = probe->size;
+	readback->format = probe->stage_format;
+	readback->color_space = probe->color_space;
+	return true;
+}
+
+void SmoothCost(double *average_ms, uint64_t cost_ns)
+{
+	const double cost_ms = static_cast<double>(cost_ns) / 1000000.0;
+	if (*average_ms <= 0.0)
+		*average_ms = cost_ms;
+	else
+		*average_ms += (cost_ms - *average_ms) * kProbeCostSmoothing;
+}
+
+void RecordProbeCost(LuminanceProbe *probe, uint64_t cost_ns)
+{
+	probe->last_cost_ns = cost_ns;
+	SmoothCost(&probe->average_cost_ms, cost_ns);
+	++probe->probes_since_auto_decision;
+}
+
+// Folds in the previous chain timing once the GPU has it. Returns true when the timer is free for the next chain.
+bool CollectChainTimer(LuminanceProbe *probe)
+{
+	if (!probe->chain_timer_pending)
+		return true;
+
+	bool disjoint = false;
+	uint64_t frequency = 0;
+	uint64_t ticks = 0;
+	if (!gs_timer_range_get_data(probe->chain_timer_range, &disjoint, &frequency) ||
+	    !gs_timer_get_data(probe->chain_timer, &ticks))
+		return false;
+
+	probe->chain_timer_pending = false;
+	if (!disjoint && frequency > 0)
+		SmoothCost(&probe->average_chain_cost_ms,
+			   static_cast<uint64_t>(static_cast<double>(ticks) * 1e9 / static_cast<double>(frequency)));
+	return true;
+}
+
+bool BeginChainTimer(LuminanceProbe *probe)
+{
+	if (!CollectChainTimer(probe))
+		return false;
+	if (!probe->chain_timer_range)
+		probe->chain_timer_range = gs_timer_range_create();
+	if (!probe->chain_timer)
+		probe->chain_timer = gs_timer_create();
+	if (!probe->chain_timer_range || !probe->chain_timer)
+		return false;
+
+	gs_timer_range_begin(probe->chain_timer_range);
+	gs_timer_begin(probe->chain_timer);
+	return true;
+}
+
+// A chain that failed part way is not worth a sample; its query is simply never read.
+void EndChainTimer(LuminanceProbe *probe, bool rendered)
+{
+	gs_timer_end(probe->chain_timer);
+	gs_timer_range_end(probe->chain_timer_range);
+	probe->chain_timer_pending = rendered;
+}
+
+// Shared by all entry points: `render_first_level` fills levels[0] (half the input size), the rest of the chain is
+// Downsample passes. Returns the size x size final level, or nullptr when a pass failed.
+template<typename RenderFirstLevel>
+gs_texture_t *RenderProbeChain(LuminanceProbe *probe, uint32_t width, uint32_t height, enum gs_color_space space,
+			       uint32_t size, RenderFirstLevel &&render_first_level)
+{
+	probe->color_space = space;
+	SetProbeTarget(probe, gs_get_format_from_space(space), std::clamp(size, kMinProbeSize, kMaxProbeSize));
+
+	std::array<ProbeLevel, kMaxProbeLevels> plan{};
+	const std::size_t level_count = PlanProbeChain(width, height, probe->size, plan);
+	if (!EnsureProbeLevels(probe, level_count))
+		return nullptr;
+
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+
+	bool rendered = render_first_level(probe->levels[0], plan[0]);
+	// Only the levels after the first depend on the probe size; the auto size is chosen from their GPU time alone.
+	// CPU time around the draws would only measure submission. While a query is in flight the chain goes untimed.
+	const bool timed = rendered && BeginChainTimer(probe);
+	for (std::size_t i = 1; rendered && i < level_count; ++i)
+		rendered = RenderDownsampleLevel(probe, gs_texrender_get_texture(probe->levels[i - 1]),
+						 probe->levels[i], plan[i], space);
+	if (timed)
+		EndChainTimer(probe, rendered);
+
+	gs_blend_state_pop();
+	return rendered ? gs_texrender_get_texture(probe->levels[level_count - 1]) : nullptr;
+}
+
+// Renders the chain and reads the final level back.
+template<typename RenderFirstLevel>
+bool RunProbeChain(LuminanceProbe *probe, uint32_t width, uint32_t height, enum gs_color_space space, uint32_t size,
+		   ProbeReadback *readback, RenderFirstLevel &&render_first_level)
+{
+	const uint64_t start_ns = os_gettime_ns();
+	gs_texture_t *result = RenderProbeChain(probe, width, height, space, size, render_first_level);
+	const bool sampled = result && EnsureProbeStage(probe) && CopyReadback(probe, result, readback);
+	RecordProbeCost(probe, os_gettime_ns() - start_ns);
+	return sampled;
+}
+
+enum gs_color_space GetProbeSourceSpace(obs_source_t *target)
+{
+	const enum gs_color_space preferred_spaces[] = {GS_CS_SRGB, GS_CS_SRGB_16F, GS_CS_709_EXTENDED};
+	return obs_source_get_color_space(target, OBS_COUNTOF(preferred_spaces), preferred_spaces);
+}
+
+} // namespace
+
+float HalfToFloat(uint16_t value)
+{
+	const uint16_t sign = value >> 15;
+	const uint16_t exponent = (value >> 10) & 0x1F;
+	const uint16_t mantissa = value & 0x03FF;
+
+	float result = 0.0f;
+	if (exponent == 0) {
+		if (mantissa != 0) {
+			result = std::ldexp(static_cast<float>(mantissa) / 1024.0f, -14);
+		}
+	} else if (exponent == 0x1F) {
+		result = mantissa ? std::numeric_limits<float>::quiet_NaN() : std::numeric_limits<float>::infinity();
+	} else {
+		result = std::ldexp(1.0f + static_cast<float>(mantissa) / 1024.0f, static_cast<int>(exponent) - 15);
+	}
+
+	return sign ? -result : result;
+}
+
+void InitLuminanceProbe(LuminanceProbe *probe, gs_effect_t *effect)
+{
+	if (!probe)
+		return;
+
+	probe->effect = effect;
+	probe->image_param = effect ? gs_effect_get_param_by_name(effect, "image") : nullptr;
+	probe->tap_offset_param = effect ? gs_effect_get_param_by_name(effect, "tap_offset") : nullptr;
+}
+
+void DestroyLuminanceProbe(LuminanceProbe *probe)
+{
+	if (!probe)
+		return;
+
+	DestroyProbeLevels(probe);
+	DestroyProbeStage(probe);
+	DestroyChainTimer(probe);
+	probe->render_format = GS_UNKNOWN;
+	probe->stage_format = GS_RGBA;
+}
+
+std::size_t PlanProbeChain(uint32_t source_width, uint32_t source_height, uint32_t size,
+			   std::array<ProbeLevel, kMaxProbeLevels> &levels)
+{
+	std::size_t count = 0;
+	uint32_t width = std::max(size, (source_width + 1) / 2);
+	uint32_t height = std::max(size, (source_height + 1) / 2);
+	while (count < kMaxProbeLevels - 1 && (width > size || height > size)) {
+		levels[count++] = {width, height};
+		width = std::max(size, (width + 3) / 4);
+		height = std::max(size, (height + 3) / 4);
+	}
+	levels[count++] = {size, size};
+	return count;
+}
+
+uint32_t SelectAutoProbeSize(LuminanceProbe *probe, uint32_t source_width, uint32_t source_height)
+{
+	const uint32_t preferred = PreferredProbeSize(source_width, source_height);
+	// Nothing measured yet. Not keyed on the stage surface: atlas probes never allocate one.
+	if (!probe || probe->render_format == GS_UNKNOWN)
+		return preferred;
+
+	const uint32_t current = std::min(probe->size, preferred);
+	if (probe->probes_since_auto_decision < kProbesPerAutoDecision)
+		return current;
+
+	probe->probes_since_auto_decision = 0;
+	if (probe->average_chain_cost_ms > kProbeCostBudgetMs && current > kMinProbeSize)
+		return current / 2;
+	if (probe->average_chain_cost_ms < kProbeCostBudgetMs * 0.25 && current < preferred)
+		return current * 2;
+	return current;
+}
+
+bool CaptureSourceProbe(LuminanceProbe *probe, obs_source_t *target, obs_source_t *parent, uint32_t size,
+			ProbeReadback *readback)
+{
+	if (!probe || !probe->effect || !target || !readback)
+		return false;
+
+	const uint32_t source_width = obs_source_get_base_width(target);
+	const uint32_t source_height = obs_source_get_base_height(target);
+	if (source_width == 0 || source_height == 0)
+		return false;
+
+	const enum gs_color_space source_space = GetProbeSourceSpace(target);
+	return RunProbeChain(probe, source_width, source_height, source_space, size, readback,
+			     [&](gs_texrender_t *render, const ProbeLevel &level) {
+				     return RenderSourceLevel(render, level, target, parent, source_space,
+							      source_width, source_height);
+			     });
+}
+
+gs_texture_t *RenderSourceProbe(LuminanceProbe *probe, obs_source_t *target, obs_source_t *parent, uint32_t size)
+{
+	if (!probe || !probe->effect || !target)
+		return nullptr;
+
+	const uint32_t source_width = obs_source_get_base_width(target);
+	const uint32_t source_height = obs_source_get_base_height(target);
+	if (source_width == 0 || source_height == 0)
+		return nullptr;
+
+	const uint64_t start_ns = os_gettime_ns();
+	const enum gs_color_space source_space = GetProbeSourceSpace(target);
+	gs_texture_t *result = RenderProbeChain(probe, source_width, source_height, source_space, size,
+						[&](gs_texrender_t *render, const ProbeLevel &level) {
+							return RenderSourceLevel(render, level, target, parent,
+										 source_space, source_width,
+										 source_height);
+						});
+	RecordProbeCost(probe, os_gettime_ns() - start_ns);
+	return result;
+}
+
+bool CaptureTextureProbe(LuminanceProbe *probe, gs_texture_t *texture, enum gs_color_space space, uint32_t size,
+			 ProbeReadback *readback)
+{
+	if (!probe || !probe->effect || !texture || !readback)
+		return false;
+
+	const uint32_t width = gs_texture_get_width(texture);
+	const uint32_t height = gs_texture_get_height(texture);
+	if (width == 0 || height == 0)
+		return false;
+
+	return RunProbeChain(probe, width, height, space, size, readback,
+			     [&](gs_texrender_t *render, const ProbeLevel &level) {
+				     return RenderDownsampleLevel(probe, texture, render, level, space);
+			     });
+}
+
+float ReduceProbeReadback(const ProbeReadback &readback)
+{
+	const uint32_t linesize = readback.size * GetPixelStride(readback.format);
+	if (readback.size == 0 || readback.texels.size() < static_cast<std::size_t>(linesize) * readback.size)
+		return 0.0f;
+	return ReduceStagedLuminance(readback.texels.data(), linesize, readback.size, readback.format);
+}
+
+} // namespace smart_gamma
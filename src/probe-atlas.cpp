@@ -0,0 +1,318 @@
+#include "smart-gamma/probe_atlas.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include <graphics/graphics.h>
+#include <graphics/vec2.h>
+#include <graphics/vec4.h>
+#include <obs-module.h>
+
+#include "smart-gamma/luminance_probe.hpp"
+
+namespace smart_gamma {
+
+namespace {
+
+constexpr uint32_t kAtlasSize = kAtlasTileSize * kAtlasTilesPerRow;
+
+static_assert(kAtlasSlotCount == static_cast<int>(kAtlasTilesPerRow * kAtlasTilesPerRow));
+static_assert(kAtlasSize / kAtlasReductionSizes.back() == kAtlasTileSize);
+
+struct AtlasSlot {
+	void *owner = nullptr;
+	AtlasResultCallback callback = nullptr;
+};
+
+// Only touched inside a graphics context.
+struct ProbeAtlas {
+	gs_effect_t *effect = nullptr;
+	gs_eparam_t *image_param = nullptr;
+	gs_eparam_t *tap_offset_param = nullptr;
+	gs_texture_t *tiles = nullptr;
+	std::array<gs_texrender_t *, kAtlasReductionSizes.size()> reduction{};
+
+	// Double buffered: the batch staged on one frame is mapped on the next, after the GPU has finished the copy.
+	std::array<gs_stagesurf_t *, 2> stages{};
+	std::array<uint64_t, 2> staged_slots{};
+	uint32_t next_stage = 0;
+
+	std::array<AtlasSlot, kAtlasSlotCount> slots{};
+	uint64_t used_slots = 0;
+	// Tiles drawn since the last reduction.
+	uint64_t drawn_slots = 0;
+	// Set when the surfaces could not be created, so filters stop retrying for the rest of the session.
+	bool unavailable = false;
+};
+
+ProbeAtlas atlas;
+
+uint64_t SlotBit(int slot)
+{
+	return uint64_t{1} << slot;
+}
+
+bool IsUsedSlot(int slot)
+{
+	return slot >= 0 && slot < kAtlasSlotCount && (atlas.used_slots & SlotBit(slot)) != 0;
+}
+
+void DestroyAtlasSurfaces()
+{
+	if (atlas.tiles) {
+		gs_texture_destroy(atlas.tiles);
+		atlas.tiles = nullptr;
+	}
+	for (gs_texrender_t *&render : atlas.reduction) {
+		if (render) {
+			gs_texrender_destroy(render);
+			render = nullptr;
+		}
+	}
+	for (gs_stagesurf_t *&stage : atlas.stages) {
+		if (stage) {
+			gs_stagesurface_destroy(stage);
+			stage = nullptr;
+		}
+	}
+	if (atlas.effect) {
+		gs_effect_destroy(atlas.effect);
+		atlas.effect = nullptr;
+		atlas.image_param = nullptr;
+		atlas.tap_offset_param = nullptr;
+	}
+	atlas.staged_slots = {};
+	atlas.next_stage = 0;
+	atlas.drawn_slots = 0;
+}
+
+// Binds the tile texture as render target for `draw`, without blending or sRGB conversion, and restores the caller's
+// target and transforms afterwards.
+template<typename Draw> void RenderToTiles(Draw &&draw)
+{
+	gs_texture_t *previous_target = gs_get_render_target();
+	gs_zstencil_t *previous_zstencil = gs_get_zstencil_target();
+	const enum gs_color_space previous_space = gs_get_color_space();
+	const bool previous_srgb = gs_framebuffer_srgb_enabled();
+
+	gs_viewport_push();
+	gs_projection_push();
+	gs_matrix_push();
+	gs_matrix_identity();
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+	gs_enable_framebuffer_srgb(false);
+
+	gs_set_render_target_with_color_space(atlas.tiles, nullptr, GS_CS_SRGB_16F);
+	draw();
+
+	gs_enable_framebuffer_srgb(previous_srgb);
+	gs_blend_state_pop();
+	gs_matrix_pop();
+	gs_projection_pop();
+	gs_viewport_pop();
+	gs_set_render_target_with_color_space(previous_target, previous_zstencil, previous_space);
+}
+
+bool CreateAtlasSurfaces(const char *effect_path)
+{
+	char *errors = nullptr;
+	atlas.effect = effect_path ? gs_effect_create_from_file(effect_path, &errors) : nullptr;
+	if (errors)
+		bfree(errors);
+	if (!atlas.effect)
+		return false;
+	atlas.image_param = gs_effect_get_param_by_name(atlas.effect, "image");
+	atlas.tap_offset_param = gs_effect_get_param_by_name(atlas.effect, "tap_offset");
+
+	// One channel is enough: tiles hold luminance only.
+	atlas.tiles = gs_texture_create(kAtlasSize, kAtlasSize, GS_R16F, 1, nullptr, GS_RENDER_TARGET);
+	for (gs_texrender_t *&render : atlas.reduction)
+		render = gs_texrender_create(GS_R16F, GS_ZS_NONE);
+	for (gs_stagesurf_t *&stage : atlas.stages)
+		stage = gs_stagesurface_create(kAtlasTilesPerRow, kAtlasTilesPerRow, GS_R16F);
+
+	const bool created =
+		atlas.tiles && std::all_of(atlas.reduction.begin(), atlas.reduction.end(), [](auto *r) { return r; }) &&
+		std::all_of(atlas.stages.begin(), atlas.stages.end(), [](auto *s) { return s; });
+	if (!created)
+		return false;
+
+	// Unused tiles are never read back, but cleared once so they cannot feed NaNs into the filtering.
+	RenderToTiles([] {
+		struct vec4 clear_color;
+		vec4_zero(&clear_color);
+		gs_clear(GS_CLEAR_COLOR, &clear_color, 0.0f, 0);
+	});
+	return true;
+}
+
+gs_texture_t *ReduceTiles()
+{
+	const bool previous_srgb = gs_framebuffer_srgb_enabled();
+	gs_enable_framebuffer_srgb(false);
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+
+	gs_texture_t *input = atlas.tiles;
+	for (std::size_t i = 0; input && i < kAtlasReductionSizes.size(); ++i) {
+		const uint32_t size = kAtlasReductionSizes[i];
+		gs_texrender_t *render = atlas.reduction[i];
+		gs_texrender_reset(render);
+		if (!gs_texrender_begin(render, size, size)) {
+			input = nullptr;
+			break;
+		}
+
+		gs_ortho(0.0f, static_cast<float>(size), 0.0f, static_cast<float>(size), -100.0f, 100.0f);
+		struct vec2 tap_offset;
+		vec2_set(&tap_offset, 0.25f / static_cast<float>(size), 0.25f / static_cast<float>(size));
+		gs_effect_set_texture(atlas.image_param, input);
+		gs_effect_set_vec2(atlas.tap_offset_param, &tap_offset);
+		while (gs_effect_loop(atlas.effect, "Downsample"))
+			gs_draw_sprite(input, 0, size, size);
+		gs_texrender_end(render);
+		input = gs_texrender_get_texture(render);
+	}
+
+	gs_blend_state_pop();
+	gs_enable_framebuffer_srgb(previous_srgb);
+	return input;
+}
+
+// Hands out the batch staged on an earlier frame. Results are copied out before the callbacks run so the surface is
+// unmapped as early as possible.
+void DeliverStagedResults()
+{
+	const uint32_t stage = atlas.next_stage ^ 1u;
+	const uint64_t slots = atlas.staged_slots[stage];
+	if (slots == 0)
+		return;
+	atlas.staged_slots[stage] = 0;
+
+	uint8_t *data = nullptr;
+	uint32_t linesize = 0;
+	if (!gs_stagesurface_map(atlas.stages[stage], &data, &linesize)) {
+		// Owners do not redraw while they wait for a result, so the tiles can simply be reduced again.
+		atlas.drawn_slots |= slots;
+		return;
+	}
+
+	std::array<float, kAtlasSlotCount> results{};
+	for (int slot = 0; slot < kAtlasSlotCount; ++slot) {
+		if ((slots & SlotBit(slot)) == 0)
+			continue;
+		const auto *row = reinterpret_cast<const uint16_t *>(data + (slot / kAtlasTilesPerRow) * linesize);
+		const float value = HalfToFloat(row[slot % kAtlasTilesPerRow]);
+		results[slot] = std::isfinite(value) ? std::max(value, 0.0f) : 0.0f;
+	}
+	gs_stagesurface_unmap(atlas.stages[stage]);
+
+	for (int slot = 0; slot < kAtlasSlotCount; ++slot) {
+		if ((slots & SlotBit(slot)) != 0)
+			atlas.slots[slot].callback(atlas.slots[slot].owner, results[slot]);
+	}
+}
+
+// Runs once per frame on the graphics thread after the main view, so the tiles drawn while it was rendered are reduced
+// and staged together: one stage and one map per frame for every filter on the atlas.
+void ProbeAtlasRendered(void * /*data*/)
+{
+	DeliverStagedResults();
+	if (atlas.drawn_slots == 0)
+		return;
+
+	// On failure the tiles stay marked and are reduced on the next frame.
+	gs_texture_t *reduced = ReduceTiles();
+	if (!reduced)
+		return;
+
+	gs_stage_texture(atlas.stages[atlas.next_stage], reduced);
+	atlas.staged_slots[atlas.next_stage] = atlas.drawn_slots;
+	atlas.drawn_slots = 0;
+	atlas.next_stage ^= 1u;
+}
+
+} // namespace
+
+int AcquireAtlasSlot(const char *effect_path, void *owner, AtlasResultCallback callback)
+{
+	if (!owner || !callback || atlas.unavailable)
+		return kNoAtlasSlot;
+
+	if (atlas.used_slots == 0) {
+		if (!CreateAtlasSurfaces(effect_path)) {
+			blog(LOG_WARNING, "Smart Gamma: shared probe atlas unavailable; filters read their probes back "
+					  "individually");
+			DestroyAtlasSurfaces();
+			atlas.unavailable = true;
+			return kNoAtlasSlot;
+		}
+		obs_add_main_rendered_callback(ProbeAtlasRendered, nullptr);
+	}
+
+	for (int slot = 0; slot < kAtlasSlotCount; ++slot) {
+		if ((atlas.used_slots & SlotBit(slot)) != 0)
+			continue;
+		atlas.used_slots |= SlotBit(slot);
+		atlas.slots[slot] = {owner, callback};
+		return slot;
+	}
+	return kNoAtlasSlot;
+}
+
+void ReleaseAtlasSlot(int slot)
+{
+	if (!IsUsedSlot(slot))
+		return;
+
+	const uint64_t bit = SlotBit(slot);
+	atlas.used_slots &= ~bit;
+	atlas.drawn_slots &= ~bit;
+	for (uint64_t &staged : atlas.staged_slots)
+		staged &= ~bit;
+	atlas.slots[slot] = {};
+
+	if (atlas.used_slots == 0) {
+		obs_remove_main_rendered_callback(ProbeAtlasRendered, nullptr);
+		DestroyAtlasSurfaces();
+	}
+}
+
+bool DrawAtlasTile(int slot, gs_texture_t *probe, enum gs_color_space space)
+{
+	if (!IsUsedSlot(slot) || !probe || !atlas.tiles)
+		return false;
+
+	const uint32_t probe_size = gs_texture_get_width(probe);
+	if (gs_texture_get_height(probe) != probe_size || probe_size < kMinProbeSize || probe_size > kMaxAtlasProbeSize)
+		return false;
+
+	const int x = static_cast<int>((static_cast<uint32_t>(slot) % kAtlasTilesPerRow) * kAtlasTileSize);
+	const int y = static_cast<int>((static_cast<uint32_t>(slot) / kAtlasTilesPerRow) * kAtlasTileSize);
+	const char *technique = space == GS_CS_SRGB ? "ProbeTile" : "ProbeTileLinear";
+	RenderToTiles([&] {
+		gs_set_viewport(x, y, static_cast<int>(kAtlasTileSize), static_cast<int>(kAtlasTileSize));
+		gs_ortho(0.0f, static_cast<float>(kAtlasTileSize), 0.0f, static_cast<float>(kAtlasTileSize), -100.0f,
+			 100.0f);
+		struct vec2 tap_offset;
+		vec2_zero(&tap_offset);
+		if (probe_size > kAtlasTileSize)
+			vec2_set(&tap_offset, 0.25f / static_cast<float>(kAtlasTileSize),
+				 0.25f / static_cast<float>(kAtlasTileSize));
+		gs_effect_set_texture(atlas.image_param, probe);
+		gs_effect_set_vec2(atlas.tap_offset_param, &tap_offset);
+		while (gs_effect_loop(atlas.effect, technique))
+			gs_draw_sprite(probe, 0, kAtlasTileSize, kAtlasTileSize);
+	});
+
+	// A batch still in flight for this tile describes the previous draw; only the newest one is reported.
+	const uint64_t bit = SlotBit(slot);
+	atlas.drawn_slots |= bit;
+	for (uint64_t &staged : atlas.staged_slots)
+		staged &= ~bit;
+	return true;
+}
+
+} // namespace smart_gamma
@@ -0,0 +1,56 @@
+#include "smart-gamma/shared_meter.hpp"
+
+#include <mutex>
+#include <unordered_map>
+
+namespace smart_gamma {
+
+namespace {
+
+std::mutex shared_meter_mutex;
+std::unordered_map<std::string, std::weak_ptr<SharedMeter>> shared_meters;
+
+} // namespace
+
+std::shared_ptr<SharedMeter> AcquireSharedMeter(const std::string &key)
+{
+	std::lock_guard<std::mutex> lock(shared_meter_mutex);
+
+	std::weak_ptr<SharedMeter> &slot = shared_meters[key];
+	std::shared_ptr<SharedMeter> meter = slot.lock();
+	if (!meter) {
+		meter = std::make_shared<SharedMeter>();
+		slot = meter;
+	}
+
+	// Acquisition is rare (filter creation, sidechain changes), so prune expired entries here.
+	for (auto it = shared_meters.begin(); it != shared_meters.end();) {
+		if (it->second.expired())
+			it = shared_meters.erase(it);
+		else
+			++it;
+	}
+	return meter;
+}
+
+void PublishSharedMeter(SharedMeter *meter, const void *publisher, float luminance, bool extended_range,
+			uint64_t now_ns)
+{
+	if (!meter)
+		return;
+
+	meter->luminance.store(luminance, std::memory_order_relaxed);
+	meter->extended_range.store(extended_range, std::memory_order_relaxed);
+	meter->publisher.store(publisher, std::memory_order_relaxed);
+	meter->updated_ns.store(now_ns, std::memory_order_release);
+}
+
+bool IsSharedMeterLedByOther(const SharedMeter &meter, const void *reader, uint64_t now_ns)
+{
+	const uint64_t updated_ns = meter.updated_ns.load(std::memory_order_acquire);
+	if (updated_ns == 0 || meter.publisher.load(std::memory_order_relaxed) == reader)
+		return false;
+	return now_ns < updated_ns || now_ns - updated_ns < kSharedMeterStaleNs;
+}
+
+} // namespace smart_gamma
@@ -1,14 +1,24 @@
 #include <algorithm>
 #include <array>
 #include <atomic>
+#include <cctype>
 #include <cmath>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <ctime>
 #include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
+#include <sys/stat.h>
+
+#include <callback/calldata.h>
+#include <callback/proc.h>
 #include <graphics/graphics.h>
 #include <graphics/matrix4.h>
 #include <graphics/vec4.h>
@@ -16,7 +26,16 @@
 #include <obs-properties.h>
 #include <util/platform.h>
 
+#include "smart-gamma/analysis_worker.hpp"
+#include "smart-gamma/controller.hpp"
+#ifdef SMART_GAMMA_HAVE_LOOKAHEAD
+#include "smart-gamma/lookahead.hpp"
+#endif
+#include "smart-gamma/luminance_probe.hpp"
 #include "smart-gamma/parameter_schema.hpp"
+#include "smart-gamma/probe_atlas.hpp"
+#include "smart-gamma/shared_meter.hpp"
+#include "smart-gamma/trace_recorder.hpp"
 
 OBS_DECLARE_MODULE()
 OBS_MODULE_USE_DEFAULT_LOCALE("smart-gamma", "en-US")
@@ -39,95 +58,194 @@ constexpr char kShowDetectedLuminanceKey[] = "smart_gamma_show_detected_luminanc
 constexpr char kSmartGammaModeKey[] = "smart_gamma_mode";
 constexpr char kModeValueAuto[] = "auto";
 constexpr char kModeValueThreshold[] = "threshold";
+constexpr char kProbeResolutionKey[] = "probe_resolution";
+constexpr char kCachedLuminanceKey[] = "smart_gamma_cached_luminance";
+constexpr char kCachedStrengthKey[] = "smart_gamma_cached_strength";
+constexpr char kTraceEnabledKey[] = "smart_gamma_trace_enabled";
+constexpr char kSidechainSourceKey[] = "sidechain_source";
+constexpr char kScopeKey[] = "smart_gamma_scope";
+constexpr char kScopeValueSource[] = "source";
+constexpr char kScopeValueProgram[] = "program";
+constexpr char kLookaheadKey[] = "smart_gamma_lookahead";
 constexpr char kDarknessInputPadding[] = "      ";
 constexpr char kDefaultInputPadding[] = "    ";
 
-constexpr uint32_t kDefaultDownsampleSize = 32;
-constexpr float kLuminanceSmoothing = 0.18f;
-constexpr float kLuminanceSampleIntervalSeconds = 1.0f / 20.0f;
-constexpr float kEpsilon = 1e-4f;
-constexpr float kAutoStrengthResponseRate = 4.0f;
-constexpr float kMinAutoBrightnessThreshold = 0.01f;
+constexpr float kSidechainRetrySeconds = 1.0f;
+constexpr float kLookaheadCheckSeconds = 1.0f;
+constexpr float kAtlasRetrySeconds = 1.0f;
+constexpr float kProbeRateSmoothing = 0.1f;
+// Trace sessions (one per enable) kept under traces/; each is at most max_files x records_per_file.
+constexpr std::size_t kMaxTraceSessions = 5;
 
 namespace {
 
-enum class SmartGammaMode {
-	AutoBrightness = 0,
-	ThresholdTrigger,
+// One measurement handed from the graphics thread to the analysis worker.
+struct LuminanceJob {
+	// A probe capture still to be reduced, or an already known luminance (sidechain meter, lookahead timeline).
+	// With neither, the controller advances on the previous sample, as it did when a probe failed.
+	smart_gamma::ProbeReadback readback;
+	bool has_readback = false;
+	bool has_luminance = false;
+	float luminance = 0.0f;
+	bool extended_range = false;
+	// Drawn into the probe atlas: the job stays staged until the atlas hands out the tile's luminance.
+	bool awaiting_atlas = false;
+	// Meter that receives the result: this filter's own source, or a sidechain source it had to probe itself.
+	std::shared_ptr<smart_gamma::SharedMeter> meter;
+
+	// Frames and seconds rendered since the previous job.
+	uint32_t frames = 0;
+	float interval_seconds = 0.0f;
+	uint64_t timestamp_ns = 0;
+	uint64_t probe_cost_ns = 0;
+	uint32_t probe_size = 0;
 };
 
-enum class SmartGammaState {
-	Idle,
-	WaitingForThreshold,
-	FadingIn,
-	Active,
-	FadingOut,
+// Counters for the stats query. Relaxed atomics written by the worker and the graphics thread, so a query never makes
+// either of them wait.
+struct InstanceStats {
+	std::atomic<uint8_t> mode{0};
+	std::atomic<uint8_t> state{0};
+	std::atomic<float> probe_rate_hz{0.0f};
+	std::atomic<uint32_t> probe_size{0};
+	std::atomic<int> atlas_tile{smart_gamma::kNoAtlasSlot};
+	std::atomic<uint64_t> probes{0};
+	// Jobs replaced in the mailbox before the worker picked them up.
+	std::atomic<uint64_t> coalesced_probes{0};
+	std::atomic<uint64_t> last_probe_cost_ns{0};
+	std::atomic<float> average_probe_cost_ms{0.0f};
+	std::atomic<uint64_t> worker_ns{0};
 };
 
-struct SmartGammaSettings {
-	SmartGammaMode mode = SmartGammaMode::AutoBrightness;
-	float darkness_threshold =
-		static_cast<float>(smart_gamma::DefaultValue(smart_gamma::Parameter::DarknessThreshold)) / 100.0f;
-	float threshold_duration_ms =
-		static_cast<float>(smart_gamma::DefaultValue(smart_gamma::Parameter::ThresholdDurationMs));
-	float fade_in_ms = static_cast<float>(smart_gamma::DefaultValue(smart_gamma::Parameter::FadeInMs));
-	float fade_out_ms = static_cast<float>(smart_gamma::DefaultValue(smart_gamma::Parameter::FadeOutMs));
-	float gamma = static_cast<float>(smart_gamma::DefaultValue(smart_gamma::Parameter::Gamma));
-	float brightness = static_cast<float>(smart_gamma::DefaultValue(smart_gamma::Parameter::Brightness));
-	float contrast = static_cast<float>(smart_gamma::DefaultValue(smart_gamma::Parameter::Contrast));
-	float saturation = static_cast<float>(smart_gamma::DefaultValue(smart_gamma::Parameter::Saturation));
+// The part of the settings the graphics and tick paths read, published on every settings update. Each field is an
+// independent relaxed atomic: a frame may mix values from two consecutive updates, but never sees a torn one.
+struct RenderSettings {
+	std::atomic<float> gamma{smart_gamma::SmartGammaSettings{}.gamma};
+	std::atomic<float> brightness{smart_gamma::SmartGammaSettings{}.brightness};
+	std::atomic<float> contrast{smart_gamma::SmartGammaSettings{}.contrast};
+	std::atomic<float> saturation{smart_gamma::SmartGammaSettings{}.saturation};
+	std::atomic<uint32_t> probe_resolution{smart_gamma::kProbeResolutionAuto};
 };
 
 struct SmartGammaFilter {
 	obs_source_t *context = nullptr;
 	gs_effect_t *effect = nullptr;
+	gs_eparam_t *image_param = nullptr;
 	gs_eparam_t *strength_param = nullptr;
 	gs_eparam_t *gamma_param = nullptr;
 	gs_eparam_t *brightness_param = nullptr;
 	gs_eparam_t *contrast_param = nullptr;
 	gs_eparam_t *saturation_param = nullptr;
 
-	gs_texrender_t *downsample_render = nullptr;
-	gs_stagesurf_t *downsample_stage = nullptr;
-	uint32_t downsample_size = kDefaultDownsampleSize;
-	enum gs_color_format downsample_format = GS_RGBA;
+	smart_gamma::LuminanceProbe probe;
 
-	SmartGammaSettings settings;
-	SmartGammaState state = SmartGammaState::Idle;
-	float effect_strength = 0.0f;
-	float smoothed_luminance = 1.0f;
+	// Settings, controller state and the trace recorder belong to the analysis worker. The UI thread takes
+	// `controller_mutex` to change them; the graphics thread never waits on it and reads `render_settings` instead.
+	std::mutex controller_mutex;
+	smart_gamma::SmartGammaSettings settings;
+	RenderSettings render_settings;
+	smart_gamma::SmartGammaController controller;
 	float latest_luminance = 1.0f;
-	float pending_tick_delta = 0.0f;
-	float time_below_threshold = 0.0f;
-	float time_above_threshold = 0.0f;
-	bool luminance_initialized = false;
-	float time_since_last_sample = 0.0f;
+	std::atomic<bool> luminance_initialized{false};
 	std::atomic<float> displayed_luminance_percent{100.0f};
+	std::atomic<bool> extended_range_source{false};
 	float last_properties_update_percent = -1.0f;
-	bool show_detected_luminance = true;
+	// Written on update, read by the worker and by the properties view on the UI thread.
+	std::atomic<bool> show_detected_luminance{true};
+	bool settings_migrated = false;
+	smart_gamma::TraceRecorder *trace_recorder = nullptr;
+
+	// Graphics thread: probe timing and the job being filled. Posting swaps it into `posted_job` under
+	// `mailbox_mutex`; the worker swaps that into `worker_job`, so readback buffers are reused, never reallocated.
+	float pending_tick_delta = 0.0f;
+	float time_since_last_sample = 0.0f;
+	uint32_t frames_since_last_sample = 0;
+	std::atomic<bool> probe_requested{false};
+	LuminanceJob staged_job;
+	std::mutex mailbox_mutex;
+	LuminanceJob posted_job;
+	bool job_posted = false;
+	LuminanceJob worker_job;
+	smart_gamma::AnalysisTask *analysis_task = nullptr;
+	// Tile in the shared probe atlas while probing at the auto size; retried once a second while the atlas is full.
+	int atlas_slot = smart_gamma::kNoAtlasSlot;
+	float atlas_retry_seconds = 0.0f;
+
+	// Controller strength (float bits, low half) and a sequence number (high half) published by the worker. The
+	// graphics thread eases its uniform toward each new value over one probe interval.
+	uint32_t strength_sequence = 0;
+	std::atomic<uint64_t> published_strength{0};
+	uint32_t applied_sequence = 0;
+	float render_strength = 0.0f;
+	float strength_from = 0.0f;
+	float strength_to = 0.0f;
+	float strength_progress = 1.0f;
+
+	InstanceStats stats;
+	// Names for the stats query, which runs on the proc handler's thread and must not read a source's name while
+	// it is renamed or destroyed. Seeded on create/filter_add and kept current from the sources' "rename" signals.
+	std::mutex names_mutex;
+	std::string filter_name;
+	std::string parent_name;
+	// Parent whose "rename" signal is connected; set and cleared on the thread adding or removing the filter.
+	obs_source_t *named_parent = nullptr;
+
+	// Meter for this filter's parent, published on every probe so sidechain followers can reuse it.
+	std::shared_ptr<smart_gamma::SharedMeter> own_meter;
+
+	// Sidechain: the name is written by the UI thread; the binding is resolved and used on the video thread only.
+	std::mutex sidechain_mutex;
+	std::string sidechain_name;
+	bool sidechain_dirty = false;
+	obs_weak_source_t *sidechain_source = nullptr;
+	std::shared_ptr<smart_gamma::SharedMeter> sidechain_meter;
+	float sidechain_retry_seconds = 0.0f;
+
+	// Program scope: the parent source passes through untouched and the composited program frame is corrected
+	// instead, from a main-rendered callback. Only one filter can own the program output.
+	std::atomic<bool> program_scope{false};
+	bool owns_program_output = false;
+	gs_texture_t *program_copy = nullptr;
+	uint64_t program_last_frame_ns = 0;
+
+#ifdef SMART_GAMMA_HAVE_LOOKAHEAD
+	// Lookahead for local media files: the UI thread writes the flags; the analyzer is owned by the video thread,
+	// which consumes `lookahead_recheck` to re-check the parent's file without waiting for the next second.
+	std::atomic<bool> lookahead_enabled{false};
+	std::atomic<bool> lookahead_recheck{false};
+	smart_gamma::LookaheadAnalyzer *lookahead = nullptr;
+	std::string lookahead_path;
+	float lookahead_check_seconds = 0.0f;
+#endif
+};
+
+struct WarmStartEntry {
+	float luminance = 1.0f;
+	float strength = 0.0f;
 };
 
+// Last controller state per parent source (keyed by UUID) so a recreated filter resumes where the previous one stopped.
+// An entry is dropped when its source is removed; removed sources never store one again.
+std::mutex warm_start_mutex;
+std::unordered_map<std::string, WarmStartEntry> warm_start_cache;
+
+std::atomic<SmartGammaFilter *> program_output_owner{nullptr};
+
+// Live filters for the stats query. Only creation, destruction and the query itself take the lock.
+std::mutex instance_registry_mutex;
+std::vector<SmartGammaFilter *> instance_registry;
+
 inline float clamp01(float value)
 {
 	return std::clamp(value, 0.0f, 1.0f);
 }
 
-inline float lerp(float a, float b, float t)
-{
-	return a + (b - a) * t;
-}
-
-SmartGammaMode ParseSmartGammaMode(const char *value)
+smart_gamma::SmartGammaMode ParseSmartGammaMode(const char *value)
 {
 	if (!value || value[0] == '\0')
-		return SmartGammaMode::AutoBrightness;
-	return std::strcmp(value, kModeValueThreshold) == 0 ? SmartGammaMode::ThresholdTrigger
-							    : SmartGammaMode::AutoBrightness;
-}
-
-bool IsAutoBrightnessMode(const SmartGammaFilter *filter)
-{
-	return !filter || filter->settings.mode == SmartGammaMode::AutoBrightness;
+		return smart_gamma::SmartGammaMode::AutoBrightness;
+	return std::strcmp(value, kModeValueThreshold) == 0 ? smart_gamma::SmartGammaMode::ThresholdTrigger
+							    : smart_gamma::SmartGammaMode::AutoBrightness;
 }
 
 const char *GetInputPaddingForParameter(smart_gamma::Parameter parameter)
@@ -145,102 +263,12 @@ const char *GetInputPaddingForParameter(smart_gamma::Parameter parameter)
 	}
 }
 
-float HalfToFloat(uint16_t value)
-{
-	const uint16_t sign = value >> 15;
-	const uint16_t exponent = (value >> 10) & 0x1F;
-	const uint16_t mantissa = value & 0x03FF;
-
-	float result = 0.0f;
-	if (exponent == 0) {
-		if (mantissa != 0) {
-			result = std::ldexp(static_cast<float>(mantissa) / 1024.0f, -14);
-		}
-	} else if (exponent == 0x1F) {
-		result = mantissa ? std::numeric_limits<float>::quiet_NaN() : std::numeric_limits<float>::infinity();
-	} else {
-		result = std::ldexp(1.0f + static_cast<float>(mantissa) / 1024.0f, static_cast<int>(exponent) - 15);
-	}
-
-	return sign ? -result : result;
-}
-
-bool IsHdrFormat(enum gs_color_format format)
-{
-	return format == GS_RGBA16F;
-}
-
-bool IsBgraFormat(enum gs_color_format format)
-{
-	switch (format) {
-	case GS_BGRA:
-	case GS_BGRX:
-	case GS_BGRA_UNORM:
-	case GS_BGRX_UNORM:
-		return true;
-	default:
-		return false;
-	}
-}
-
-bool IsRgbaFormat(enum gs_color_format format)
-{
-	switch (format) {
-	case GS_RGBA:
-	case GS_RGBA_UNORM:
-		return true;
-	default:
-		return false;
-	}
-}
-
 std::string GetShaderPath()
 {
 	const char *path = obs_module_file("shaders/smart-gamma.effect");
 	return path ? path : std::string{};
 }
 
-void DestroyDownsampleSurfaces(SmartGammaFilter *filter)
-{
-	if (!filter)
-		return;
-
-	if (filter->downsample_render) {
-		gs_texrender_destroy(filter->downsample_render);
-		filter->downsample_render = nullptr;
-	}
-
-	if (filter->downsample_stage) {
-		gs_stagesurface_destroy(filter->downsample_stage);
-		filter->downsample_stage = nullptr;
-	}
-}
-
-bool EnsureDownsampleSurfaces(SmartGammaFilter *filter, enum gs_color_format format)
-{
-	if (!filter)
-		return false;
-
-	if (filter->downsample_render && filter->downsample_stage && filter->downsample_format == format)
-		return true;
-
-	DestroyDownsampleSurfaces(filter);
-
-	filter->downsample_render = gs_texrender_create(format, GS_ZS_NONE);
-	filter->downsample_stage =
-		gs_stagesurface_create(filter->downsample_size, filter->downsample_size, gs_generalize_format(format));
-	if (filter->downsample_stage)
-		filter->downsample_format = gs_stagesurface_get_color_format(filter->downsample_stage);
-	else
-		filter->downsample_format = GS_RGBA;
-	if (!filter->downsample_render || !filter->downsample_stage) {
-		DestroyDownsampleSurfaces(filter);
-		return false;
-	}
-
-	return true;
-}
-
 void DestroyGraphicsResources(SmartGammaFilter *filter)
 {
 	if (!filter)
@@ -250,6 +278,7 @@ void DestroyGraphicsResources(SmartGammaFilter *filter)
 	if (filter->effect) {
 		gs_effect_destroy(filter->effect);
 		filter->effect = nullptr;
+		filter->image_param = nullptr;
 		filter->strength_param = nullptr;
 		filter->gamma_param = nullptr;
 		filter->brightness_param = nullptr;
@@ -257,7 +286,12 @@ void DestroyGraphicsResources(SmartGammaFilter *filter)
 		filter->saturation_param = nullptr;
 	}
 
-	DestroyDownsampleSurfaces(filter);
+	if (filter->program_copy) {
+		gs_texture_destroy(filter->program_copy);
+		filter->program_copy = nullptr;
+	}
+
+	smart_gamma::DestroyLuminanceProbe(&filter->probe);
 	obs_leave_graphics();
 }
 
@@ -269,27 +303,24 @@ bool CreateGraphicsResources(SmartGammaFilter *filter)
 	bool success = true;
 	obs_enter_graphics();
 
-	if (!EnsureDownsampleSurfaces(filter, GS_RGBA))
+	const std::string shader_path = GetShaderPath();
+	char *errors = nullptr;
+	filter->effect = gs_effect_create_from_file(shader_path.c_str(), &errors);
+	if (!filter->effect) {
+		blog(LOG_ERROR, "Smart Gamma: failed to load shader %s (%s)", shader_path.c_str(),
+		     errors ? errors : "unknown");
 		success = false;
-
-	if (success) {
-		const std::string shader_path = GetShaderPath();
-		char *errors = nullptr;
-		filter->effect = gs_effect_create_from_file(shader_path.c_str(), &errors);
-		if (!filter->effect) {
-			blog(LOG_ERROR, "Smart Gamma: failed to load shader %s (%s)", shader_path.c_str(),
-			     errors ? errors : "unknown");
-			success = false;
-		} else {
-			filter->strength_param = gs_effect_get_param_by_name(filter->effect, "effect_strength");
-			filter->gamma_param = gs_effect_get_param_by_name(filter->effect, "gamma_adjust");
-			filter->brightness_param = gs_effect_get_param_by_name(filter->effect, "brightness_offset");
-			filter->contrast_param = gs_effect_get_param_by_name(filter->effect, "contrast_adjust");
-			filter->saturation_param = gs_effect_get_param_by_name(filter->effect, "saturation_adjust");
-		}
-		if (errors)
-			bfree(errors);
+	} else {
+		filter->image_param = gs_effect_get_param_by_name(filter->effect, "image");
+		filter->strength_param = gs_effect_get_param_by_name(filter->effect, "effect_strength");
+		filter->gamma_param = gs_effect_get_param_by_name(filter->effect, "gamma_adjust");
+		filter->brightness_param = gs_effect_get_param_by_name(filter->effect, "brightness_offset");
+		filter->contrast_param = gs_effect_get_param_by_name(filter->effect, "contrast_adjust");
+		filter->saturation_param = gs_effect_get_param_by_name(filter->effect, "saturation_adjust");
+		smart_gamma::InitLuminanceProbe(&filter->probe, filter->effect);
 	}
+	if (errors)
+		bfree(errors);
 
 	obs_leave_graphics();
 	return success;
@@ -299,214 +330,479 @@ void ResetState(SmartGammaFilter *filter)
 {
 	if (!filter)
 		return;
-	filter->state = SmartGammaState::Idle;
-	filter->effect_strength = 0.0f;
-	filter->smoothed_luminance = 1.0f;
+	filter->controller = {};
 	filter->latest_luminance = 1.0f;
-	filter->time_below_threshold = 0.0f;
-	filter->time_above_threshold = 0.0f;
 	filter->pending_tick_delta = 0.0f;
-	filter->luminance_initialized = false;
+	filter->luminance_initialized.store(false, std::memory_order_relaxed);
 	filter->time_since_last_sample = 0.0f;
-	filter->downsample_format = GS_RGBA;
+	filter->frames_since_last_sample = 0;
 	filter->displayed_luminance_percent.store(100.0f, std::memory_order_relaxed);
 	filter->last_properties_update_percent = -1.0f;
 }
 
-void UpdateSettingsFromObs(SmartGammaFilter *filter, obs_data_t *settings)
+// Caller holds controller_mutex.
+void PublishStrength(SmartGammaFilter *filter)
 {
-	if (!filter || !settings)
+	const float strength = clamp01(filter->controller.effect_strength);
+	uint32_t bits = 0;
+	std::memcpy(&bits, &strength, sizeof(bits));
+	// Zero means "nothing published yet".
+	if (++filter->strength_sequence == 0)
+		++filter->strength_sequence;
+	filter->published_strength.store((static_cast<uint64_t>(filter->strength_sequence) << 32) | bits,
+					 std::memory_order_release);
+}
+
+void ApplyWarmStart(SmartGammaFilter *filter, const WarmStartEntry &entry)
+{
+	if (!filter)
+		return;
+
+	std::lock_guard<std::mutex> lock(filter->controller_mutex);
+	if (filter->luminance_initialized.load(std::memory_order_relaxed))
 		return;
 
-	const SmartGammaMode previous_mode = filter->settings.mode;
-	const char *mode_value = obs_data_get_string(settings, kSmartGammaModeKey);
-	filter->settings.mode = ParseSmartGammaMode(mode_value);
+	smart_gamma::SmartGammaController &controller = filter->controller;
+	controller.smoothed_luminance = std::max(entry.luminance, 0.0f);
+	controller.effect_strength = clamp01(entry.strength);
+	controller.state = smart_gamma::StateForStrength(controller, filter->settings, controller.effect_strength);
+	filter->latest_luminance = controller.smoothed_luminance;
+	filter->luminance_initialized.store(true, std::memory_order_relaxed);
+	filter->displayed_luminance_percent.store(controller.smoothed_luminance * 100.0f, std::memory_order_relaxed);
+	PublishStrength(filter);
+}
+
+void ApplyWarmStartFromSettings(SmartGammaFilter *filter, obs_data_t *settings)
+{
+	if (!filter || !settings || filter->luminance_initialized.load(std::memory_order_relaxed) ||
+	    !obs_data_has_user_value(settings, kCachedLuminanceKey))
+		return;
+
+	WarmStartEntry entry;
+	entry.luminance = static_cast<float>(obs_data_get_double(settings, kCachedLuminanceKey));
+	entry.strength = static_cast<float>(obs_data_get_double(settings, kCachedStrengthKey));
+	ApplyWarmStart(filter, entry);
+}
+
+void ApplyWarmStartFromCache(SmartGammaFilter *filter, obs_source_t *parent)
+{
+	const char *uuid = parent ? obs_source_get_uuid(parent) : nullptr;
+	if (!filter || !uuid)
+		return;
+
+	WarmStartEntry entry;
+	{
+		std::lock_guard<std::mutex> lock(warm_start_mutex);
+		const auto it = warm_start_cache.find(uuid);
+		if (it == warm_start_cache.end())
+			return;
+		entry = it->second;
+	}
+	ApplyWarmStart(filter, entry);
+}
+
+void StoreWarmStart(SmartGammaFilter *filter, obs_source_t *parent)
+{
+	const char *uuid = parent ? obs_source_get_uuid(parent) : nullptr;
+	// A removed parent still detaches its filters while it is destroyed; its UUID will not come back.
+	if (!filter || !filter->luminance_initialized.load(std::memory_order_relaxed) || !uuid ||
+	    obs_source_removed(parent))
+		return;
+
+	WarmStartEntry entry;
+	{
+		std::lock_guard<std::mutex> lock(filter->controller_mutex);
+		entry = {filter->controller.smoothed_luminance, filter->controller.effect_strength};
+	}
+	std::lock_guard<std::mutex> lock(warm_start_mutex);
+	warm_start_cache[uuid] = entry;
+}
+
+// Global "source_remove" signal.
+void HandleSourceRemoved(void * /*data*/, calldata_t *call_data)
+{
+	auto *source = static_cast<obs_source_t *>(calldata_ptr(call_data, "source"));
+	const char *uuid = source ? obs_source_get_uuid(source) : nullptr;
+	if (!uuid)
+		return;
+
+	std::lock_guard<std::mutex> lock(warm_start_mutex);
+	warm_start_cache.erase(uuid);
+}
+
+void MigrateLegacySettings(obs_data_t *settings)
+{
+	if (obs_data_get_bool(settings, kDarknessThresholdPercentKey))
+		return;
+
+	const char *key = smart_gamma::GetDescriptor(smart_gamma::Parameter::DarknessThreshold).settings_key;
+	const float stored_value = static_cast<float>(obs_data_get_double(settings, key));
+	// Older builds stored the normalized 0-1 value directly; preserve that scale and migrate once.
+	if (stored_value <= 1.0f)
+		obs_data_set_double(settings, key, static_cast<double>(clamp01(stored_value) * 100.0f));
+	obs_data_set_bool(settings, kDarknessThresholdPercentKey, true);
+}
+
+smart_gamma::SmartGammaSettings ReadSettings(obs_data_t *settings)
+{
+	smart_gamma::SmartGammaSettings result;
+	result.mode = ParseSmartGammaMode(obs_data_get_string(settings, kSmartGammaModeKey));
 
 	for (std::size_t i = 0; i < static_cast<std::size_t>(smart_gamma::Parameter::Count); ++i) {
 		const auto &descriptor = smart_gamma::kParameterDescriptors[i];
-		const double value = obs_data_get_double(settings, descriptor.settings_key);
+		const float value = static_cast<float>(obs_data_get_double(settings, descriptor.settings_key));
 		switch (static_cast<smart_gamma::Parameter>(i)) {
-		case smart_gamma::Parameter::DarknessThreshold: {
-			const bool stored_as_percent = obs_data_get_bool(settings, kDarknessThresholdPercentKey);
-			const float stored_value = static_cast<float>(value);
-			if (stored_as_percent || stored_value > 1.0f) {
-				filter->settings.darkness_threshold = stored_value / 100.0f;
-				obs_data_set_bool(settings, kDarknessThresholdPercentKey, true);
-			} else {
-				// Older builds stored the normalized 0-1 value directly; preserve that scale and migrate once.
-				filter->settings.darkness_threshold = clamp01(stored_value);
-				obs_data_set_double(settings, descriptor.settings_key,
-						    static_cast<double>(filter->settings.darkness_threshold * 100.0f));
-				obs_data_set_bool(settings, kDarknessThresholdPercentKey, true);
-			}
+		case smart_gamma::Parameter::DarknessThreshold:
+			result.darkness_threshold = value / 100.0f;
 			break;
-		}
 		case smart_gamma::Parameter::ThresholdDurationMs:
-			filter->settings.threshold_duration_ms = static_cast<float>(value);
+			result.threshold_duration_ms = value;
 			break;
 		case smart_gamma::Parameter::FadeInMs:
-			filter->settings.fade_in_ms = static_cast<float>(value);
+			result.fade_in_ms = value;
 			break;
 		case smart_gamma::Parameter::FadeOutMs:
-			filter->settings.fade_out_ms = static_cast<float>(value);
+			result.fade_out_ms = value;
 			break;
 		case smart_gamma::Parameter::Gamma:
-			filter->settings.gamma = static_cast<float>(value);
+			result.gamma = value;
 			break;
 		case smart_gamma::Parameter::Brightness:
-			filter->settings.brightness = static_cast<float>(value);
+			result.brightness = value;
 			break;
 		case smart_gamma::Parameter::Contrast:
-			filter->settings.contrast = static_cast<float>(value);
+			result.contrast = value;
 			break;
 		case smart_gamma::Parameter::Saturation:
-			filter->settings.saturation = static_cast<float>(value);
+			result.saturation = value;
 			break;
 		default:
 			break;
 		}
 	}
 
-	filter->show_detected_luminance = obs_data_get_bool(settings, kShowDetectedLuminanceKey);
-	obs_data_set_bool(settings, kShowDetectedLuminanceKey, filter->show_detected_luminance);
+	const long long probe_resolution = obs_data_get_int(settings, kProbeResolutionKey);
+	const long long min_size = smart_gamma::kMinProbeSize;
+	const long long max_size = smart_gamma::kMaxProbeSize;
+	result.probe_resolution = smart_gamma::kProbeResolutionAuto;
+	if (probe_resolution > 0)
+		result.probe_resolution = static_cast<uint32_t>(std::clamp(probe_resolution, min_size, max_size));
+	return result;
+}
 
-	if (previous_mode != filter->settings.mode) {
-		filter->state = SmartGammaState::Idle;
-		filter->effect_strength = 0.0f;
-		filter->time_below_threshold = 0.0f;
-		filter->time_above_threshold = 0.0f;
-	}
+bool SettingsEqual(const smart_gamma::SmartGammaSettings &previous, const smart_gamma::SmartGammaSettings &next)
+{
+	return previous.mode == next.mode && previous.darkness_threshold == next.darkness_threshold &&
+	       previous.threshold_duration_ms == next.threshold_duration_ms && previous.fade_in_ms == next.fade_in_ms &&
+	       previous.fade_out_ms == next.fade_out_ms && previous.gamma == next.gamma &&
+	       previous.brightness == next.brightness && previous.contrast == next.contrast &&
+	       previous.saturation == next.saturation && previous.probe_resolution == next.probe_resolution;
 }
 
-float SampleLuminance(SmartGammaFilter *filter)
+void PublishRenderSettings(SmartGammaFilter *filter, const smart_gamma::SmartGammaSettings &settings)
 {
-	if (!filter || !filter->downsample_render || !filter->downsample_stage || !filter->context)
-		return filter ? filter->latest_luminance : 1.0f;
+	RenderSettings &render = filter->render_settings;
+	render.gamma.store(settings.gamma, std::memory_order_relaxed);
+	render.brightness.store(settings.brightness, std::memory_order_relaxed);
+	render.contrast.store(settings.contrast, std::memory_order_relaxed);
+	render.saturation.store(settings.saturation, std::memory_order_relaxed);
+	render.probe_resolution.store(settings.probe_resolution, std::memory_order_relaxed);
+}
 
-	obs_source_t *target = obs_filter_get_target(filter->context);
-	obs_source_t *parent = obs_filter_get_parent(filter->context);
-	if (!target || !parent)
-		return filter->latest_luminance;
+void UpdateSettingsFromObs(SmartGammaFilter *filter, obs_data_t *settings)
+{
+	if (!filter || !settings)
+		return;
 
-	const enum gs_color_space preferred_spaces[] = {GS_CS_SRGB, GS_CS_SRGB_16F, GS_CS_709_EXTENDED};
-	const enum gs_color_space source_space =
-		obs_source_get_color_space(target, OBS_COUNTOF(preferred_spaces), preferred_spaces);
-	const enum gs_color_format required_format = gs_get_format_from_space(source_space);
-	if (!EnsureDownsampleSurfaces(filter, required_format))
-		return filter->latest_luminance;
+	if (!filter->settings_migrated) {
+		MigrateLegacySettings(settings);
+		filter->settings_migrated = true;
+	}
 
-	const uint32_t size = filter->downsample_size;
-	float luminance = filter->latest_luminance;
+	const char *sidechain_name = obs_data_get_string(settings, kSidechainSourceKey);
+	{
+		std::lock_guard<std::mutex> lock(filter->sidechain_mutex);
+		if (filter->sidechain_name != sidechain_name) {
+			filter->sidechain_name = sidechain_name;
+			filter->sidechain_dirty = true;
+		}
+	}
 
-	gs_texrender_reset(filter->downsample_render);
-	gs_blend_state_push();
-	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+	filter->show_detected_luminance.store(obs_data_get_bool(settings, kShowDetectedLuminanceKey),
+					      std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> lock(filter->controller_mutex);
+
+	const smart_gamma::SmartGammaSettings next = ReadSettings(settings);
+	PublishRenderSettings(filter, next);
+	if (SettingsEqual(filter->settings, next))
+		return;
+
+	const bool mode_changed = filter->settings.mode != next.mode;
+	filter->settings = next;
+	filter->stats.mode.store(static_cast<uint8_t>(next.mode), std::memory_order_relaxed);
+
+	// Controller timings are read live by the next job, and the render side has its own copy; only the
+	// mode-specific controller timers need explicit invalidation.
+	if (mode_changed) {
+		// Keep the current strength so switching modes does not flash; only the mode-specific timers restart.
+		smart_gamma::SmartGammaController &controller = filter->controller;
+		controller.state =
+			smart_gamma::StateForStrength(controller, filter->settings, controller.effect_strength);
+		controller.time_below_threshold = 0.0f;
+		controller.time_above_threshold = 0.0f;
+	}
+}
+
+// Runs on the analysis worker with controller_mutex held.
+void StoreSampledLuminance(SmartGammaFilter *filter, float luminance, bool extended_range)
+{
+	// Not clamped: extended-range sources report highlights above SDR white (1.0).
+	filter->latest_luminance = std::max(luminance, 0.0f);
+	filter->extended_range_source.store(extended_range, std::memory_order_relaxed);
+	if (!filter->luminance_initialized.load(std::memory_order_relaxed)) {
+		filter->controller.smoothed_luminance = filter->latest_luminance;
+		filter->luminance_initialized.store(true, std::memory_order_relaxed);
+	}
+}
+
+uint32_t GetProbeSize(SmartGammaFilter *filter, obs_source_t *source)
+{
+	const uint32_t probe_resolution = filter->render_settings.probe_resolution.load(std::memory_order_relaxed);
+	if (probe_resolution != smart_gamma::kProbeResolutionAuto)
+		return probe_resolution;
+	return smart_gamma::SelectAutoProbeSize(&filter->probe, obs_source_get_base_width(source),
+						obs_source_get_base_height(source));
+}
+
+void SetCapturedProbe(LuminanceJob &job, const std::shared_ptr<smart_gamma::SharedMeter> &meter)
+{
+	job.has_readback = true;
+	job.extended_range = job.readback.color_space == GS_CS_709_EXTENDED;
+	job.meter = meter;
+}
+
+void SetKnownLuminance(LuminanceJob &job, float luminance, bool extended_range)
+{
+	job.has_luminance = true;
+	job.luminance = luminance;
+	job.extended_range = extended_range;
+}
 
-	if (gs_texrender_begin_with_color_space(filter->downsample_render, size, size, source_space)) {
-		struct vec4 clear_color;
-		vec4_zero(&clear_color);
-		gs_clear(GS_CLEAR_COLOR, &clear_color, 0.0f, 0);
-		gs_ortho(0.0f, static_cast<float>(size), 0.0f, static_cast<float>(size), -100.0f, 100.0f);
-
-		const uint32_t parent_flags = obs_source_get_output_flags(target);
-		const bool custom_draw = (parent_flags & OBS_SOURCE_CUSTOM_DRAW) != 0;
-		const bool async = (parent_flags & OBS_SOURCE_ASYNC) != 0;
-
-		gs_matrix_push();
-		gs_matrix_identity();
-		const uint32_t source_width = obs_source_get_base_width(target);
-		const uint32_t source_height = obs_source_get_base_height(target);
-		if (source_width > 0 && source_height > 0) {
-			const float scale_x = static_cast<float>(size) / static_cast<float>(source_width);
-			const float scale_y = static_cast<float>(size) / static_cast<float>(source_height);
-			gs_matrix_scale3f(scale_x, scale_y, 1.0f);
+void PostLuminanceJob(SmartGammaFilter *filter)
+{
+	LuminanceJob &job = filter->staged_job;
+	job.timestamp_ns = os_gettime_ns();
+	job.probe_cost_ns = filter->probe.last_cost_ns;
+	job.probe_size = filter->probe.size;
+
+	InstanceStats &stats = filter->stats;
+	stats.last_probe_cost_ns.store(job.probe_cost_ns, std::memory_order_relaxed);
+	stats.average_probe_cost_ms.store(static_cast<float>(filter->probe.average_cost_ms), std::memory_order_relaxed);
+	stats.probe_size.store(job.probe_size, std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lock(filter->mailbox_mutex);
+		// The worker has not picked up the previous job: this one replaces it, but the controller still has to
+		// cover the frames of both.
+		if (filter->job_posted) {
+			job.frames += filter->posted_job.frames;
+			job.interval_seconds += filter->posted_job.interval_seconds;
+			stats.coalesced_probes.fetch_add(1, std::memory_order_relaxed);
 		}
+		std::swap(job, filter->posted_job);
+		filter->job_posted = true;
+	}
+	smart_gamma::ScheduleAnalysisTask(filter->analysis_task);
+}
 
-		if (target == parent && !custom_draw && !async)
-			obs_source_default_render(target);
-		else
-			obs_source_video_render(target);
+// Called by the atlas on the graphics thread once the tile drawn for the staged job has been read back.
+void DeliverAtlasLuminance(void *data, float luminance)
+{
+	auto *filter = static_cast<SmartGammaFilter *>(data);
+	LuminanceJob &job = filter->staged_job;
+	if (!job.awaiting_atlas)
+		return;
 
-		gs_matrix_pop();
+	job.awaiting_atlas = false;
+	SetKnownLuminance(job, luminance, job.extended_range);
+	PostLuminanceJob(filter);
+}
+
+// Gives the tile back once the filter no longer probes at the auto size. A result still in flight is dropped and the
+// next frame probes again; its frames and time go into that probe, so the controller still covers them.
+void ReleaseAtlasTile(SmartGammaFilter *filter)
+{
+	if (filter->atlas_slot == smart_gamma::kNoAtlasSlot)
+		return;
 
-		gs_texrender_end(filter->downsample_render);
+	obs_enter_graphics();
+	smart_gamma::ReleaseAtlasSlot(filter->atlas_slot);
+	obs_leave_graphics();
+	filter->atlas_slot = smart_gamma::kNoAtlasSlot;
+	filter->stats.atlas_tile.store(smart_gamma::kNoAtlasSlot, std::memory_order_relaxed);
+	LuminanceJob &job = filter->staged_job;
+	if (job.awaiting_atlas) {
+		job.awaiting_atlas = false;
+		filter->frames_since_last_sample += job.frames;
+		filter->time_since_last_sample += job.interval_seconds;
+		filter->probe_requested.store(true, std::memory_order_relaxed);
 	}
+}
 
-	gs_blend_state_pop();
+// At the auto probe size the final level goes into this filter's atlas tile instead of its own stage surface, so
+// every such filter shares one readback per frame. False when the filter has to read its probe back itself.
+bool CaptureAtlasProbe(SmartGammaFilter *filter, obs_source_t *source, obs_source_t *parent, LuminanceJob &job)
+{
+	const uint32_t probe_resolution = filter->render_settings.probe_resolution.load(std::memory_order_relaxed);
+	if (probe_resolution != smart_gamma::kProbeResolutionAuto)
+		return false;
 
-	gs_texture_t *downsampled = gs_texrender_get_texture(filter->downsample_render);
-	if (downsampled) {
-		gs_stage_texture(filter->downsample_stage, downsampled);
-		gs_flush();
-		uint8_t *data = nullptr;
-		uint32_t linesize = 0;
-		if (gs_stagesurface_map(filter->downsample_stage, &data, &linesize)) {
-			const bool hdr_format = IsHdrFormat(filter->downsample_format);
-			const bool bgra_format = IsBgraFormat(filter->downsample_format);
-			const bool rgba_format = IsRgbaFormat(filter->downsample_format);
-			const uint32_t pixel_stride = hdr_format ? 8u : 4u;
-			const double ldr_scale = 1.0 / 255.0;
-			double accum = 0.0;
-			for (uint32_t y = 0; y < size; ++y) {
-				const uint8_t *row = data + (static_cast<size_t>(y) * linesize);
-				for (uint32_t x = 0; x < size; ++x) {
-					const uint8_t *pixel = row + static_cast<size_t>(x) * pixel_stride;
-					float r = 0.0f;
-					float g = 0.0f;
-					float b = 0.0f;
-					if (hdr_format) {
-						const auto *channels = reinterpret_cast<const uint16_t *>(pixel);
-						r = clamp01(HalfToFloat(channels[0]));
-						g = clamp01(HalfToFloat(channels[1]));
-						b = clamp01(HalfToFloat(channels[2]));
-					} else if (bgra_format) {
-						r = static_cast<float>(pixel[2]) * static_cast<float>(ldr_scale);
-						g = static_cast<float>(pixel[1]) * static_cast<float>(ldr_scale);
-						b = static_cast<float>(pixel[0]) * static_cast<float>(ldr_scale);
-					} else if (rgba_format) {
-						r = static_cast<float>(pixel[0]) * static_cast<float>(ldr_scale);
-						g = static_cast<float>(pixel[1]) * static_cast<float>(ldr_scale);
-						b = static_cast<float>(pixel[2]) * static_cast<float>(ldr_scale);
-					} else {
-						// Fallback: assume first three channels are RGB order
-						r = static_cast<float>(pixel[0]) * static_cast<float>(ldr_scale);
-						g = static_cast<float>(pixel[1]) * static_cast<float>(ldr_scale);
-						b = static_cast<float>(pixel[2]) * static_cast<float>(ldr_scale);
-					}
-					accum += 0.2126 * r + 0.7152 * g + 0.0722 * b;
-				}
-			}
-			const double count = static_cast<double>(size) * static_cast<double>(size);
-			luminance = static_cast<float>(accum / std::max(count, 1.0));
-			gs_stagesurface_unmap(filter->downsample_stage);
+	if (filter->atlas_slot == smart_gamma::kNoAtlasSlot) {
+		filter->atlas_retry_seconds -= job.interval_seconds;
+		if (filter->atlas_retry_seconds > 0.0f)
+			return false;
+		filter->atlas_slot =
+			smart_gamma::AcquireAtlasSlot(GetShaderPath().c_str(), filter, DeliverAtlasLuminance);
+		filter->stats.atlas_tile.store(filter->atlas_slot, std::memory_order_relaxed);
+		if (filter->atlas_slot == smart_gamma::kNoAtlasSlot) {
+			filter->atlas_retry_seconds = kAtlasRetrySeconds;
+			return false;
 		}
 	}
 
-	filter->latest_luminance = clamp01(luminance);
-	if (!filter->luminance_initialized) {
-		filter->smoothed_luminance = filter->latest_luminance;
-		filter->luminance_initialized = true;
+	// The auto size still picks the chain (16/32/64 by source size and cost); any of them fits into a tile.
+	const uint32_t size = std::min(GetProbeSize(filter, source), smart_gamma::kMaxAtlasProbeSize);
+	gs_texture_t *probe = smart_gamma::RenderSourceProbe(&filter->probe, source, parent, size);
+	if (!probe || !smart_gamma::DrawAtlasTile(filter->atlas_slot, probe, filter->probe.color_space))
+		return false;
+
+	job.awaiting_atlas = true;
+	job.extended_range = filter->probe.color_space == GS_CS_709_EXTENDED;
+	return true;
+}
+
+// Probes `source` through the atlas when possible, otherwise reads the probe back for the worker to reduce.
+bool CaptureSourceLuminance(SmartGammaFilter *filter, obs_source_t *source, obs_source_t *parent,
+			    const std::shared_ptr<smart_gamma::SharedMeter> &meter, LuminanceJob &job)
+{
+	if (CaptureAtlasProbe(filter, source, parent, job)) {
+		job.meter = meter;
+		return true;
 	}
-	return filter->latest_luminance;
+	if (!smart_gamma::CaptureSourceProbe(&filter->probe, source, parent, GetProbeSize(filter, source),
+					     &job.readback))
+		return false;
+	SetCapturedProbe(job, meter);
+	return true;
 }
 
-void MaybeUpdateLuminanceDisplay(SmartGammaFilter *filter)
+// Set while a follower renders its sidechain source, so filters inside that source (or the follower itself, if the
+// sidechain contains it) never start a nested sidechain probe.
+thread_local bool rendering_sidechain = false;
+
+// True when `source` can be drawn without its filters: it has none, or it renders through the default effect.
+// Async and custom-draw sources only skip their filters while libobs is already rendering their filter chain.
+bool CanRenderUnfiltered(obs_source_t *source)
+{
+	const uint32_t flags = obs_source_get_output_flags(source);
+	return obs_source_filter_count(source) == 0 || (flags & (OBS_SOURCE_ASYNC | OBS_SOURCE_CUSTOM_DRAW)) == 0;
+}
+
+// Followers reuse whoever keeps the sidechain meter fresh: a Smart Gamma filter first in the sidechain source's
+// chain, or another follower. Only when the meter goes stale does this follower probe the sidechain source itself,
+// without its filters, and the worker publishes the result for the rest. A source that cannot be drawn unfiltered is
+// probed as rendered for this follower alone, so the meter never mixes in filtered output.
+void CaptureSidechainLuminance(SmartGammaFilter *filter, LuminanceJob &job)
+{
+	smart_gamma::SharedMeter *meter = filter->sidechain_meter.get();
+	if (!smart_gamma::IsSharedMeterLedByOther(*meter, filter, os_gettime_ns()) && !rendering_sidechain) {
+		obs_source_t *source = obs_weak_source_get_source(filter->sidechain_source);
+		if (source) {
+			rendering_sidechain = true;
+			const bool unfiltered = CanRenderUnfiltered(source);
+			const bool captured =
+				CaptureSourceLuminance(filter, source, unfiltered ? source : nullptr,
+						       unfiltered ? filter->sidechain_meter : nullptr, job);
+			rendering_sidechain = false;
+			obs_source_release(source);
+			if (captured)
+				return;
+		}
+	}
+
+	if (meter->updated_ns.load(std::memory_order_acquire) != 0)
+		SetKnownLuminance(job, meter->luminance.load(std::memory_order_relaxed),
+				  meter->extended_range.load(std::memory_order_relaxed));
+}
+
+#ifdef SMART_GAMMA_HAVE_LOOKAHEAD
+// Reads the parent's brightness from the pre-analyzed timeline, slightly ahead of the playhead so smoothing lands on
+// scene cuts instead of trailing them. False when the playhead is past what has been analyzed so far.
+bool SampleLookaheadLuminance(SmartGammaFilter *filter, obs_source_t *parent, float *luminance)
+{
+	if (!filter->lookahead)
+		return false;
+
+	// The playhead only means something while playing or paused; stopped, ended, buffering or errored media is
+	// metered by the GPU probe.
+	const enum obs_media_state state = obs_source_media_get_state(parent);
+	if (state != OBS_MEDIA_STATE_PLAYING && state != OBS_MEDIA_STATE_PAUSED)
+		return false;
+
+	const double seconds =
+		static_cast<double>(obs_source_media_get_time(parent)) / 1000.0 + smart_gamma::kLookaheadLeadSeconds;
+	return smart_gamma::LookupLookaheadLuminance(filter->lookahead, seconds, luminance);
+}
+#endif
+
+// Graphics-thread half of a probe: render and copy the readback into `job` (or draw it into the atlas), leaving the
+// reduction to the worker.
+void CaptureLuminance(SmartGammaFilter *filter, LuminanceJob &job)
 {
-	if (!filter || !filter->context)
+	if (filter->sidechain_meter) {
+		CaptureSidechainLuminance(filter, job);
 		return;
+	}
 
-	const float percent = clamp01(filter->smoothed_luminance) * 100.0f;
-	filter->displayed_luminance_percent.store(percent, std::memory_order_relaxed);
-	if (!filter->show_detected_luminance)
+	obs_source_t *target = obs_filter_get_target(filter->context);
+	obs_source_t *parent = obs_filter_get_parent(filter->context);
+	if (!target || !parent)
 		return;
 
+	if (!filter->own_meter) {
+		const char *uuid = obs_source_get_uuid(parent);
+		if (uuid)
+			filter->own_meter = smart_gamma::AcquireSharedMeter(uuid);
+	}
+
+#ifdef SMART_GAMMA_HAVE_LOOKAHEAD
+	float timeline_luminance = 0.0f;
+	if (SampleLookaheadLuminance(filter, parent, &timeline_luminance)) {
+		SetKnownLuminance(job, timeline_luminance, false);
+		job.meter = filter->own_meter;
+		return;
+	}
+#endif
+
+	// Only the first filter in the chain sees the source unfiltered, which is what the meter carries.
+	CaptureSourceLuminance(filter, target, parent, target == parent ? filter->own_meter : nullptr, job);
+}
+
+// Returns true when the properties view should be refreshed; the caller does that after dropping controller_mutex.
+bool UpdateLuminanceDisplay(SmartGammaFilter *filter)
+{
+	const float percent = std::max(filter->controller.smoothed_luminance, 0.0f) * 100.0f;
+	filter->displayed_luminance_percent.store(percent, std::memory_order_relaxed);
+	if (!filter->show_detected_luminance.load(std::memory_order_relaxed))
+		return false;
+
 	const bool needs_refresh = filter->last_properties_update_percent < 0.0f ||
 				   std::fabs(percent - filter->last_properties_update_percent) >= 0.5f;
 	if (!needs_refresh)
-		return;
+		return false;
 
 	filter->last_properties_update_percent = percent;
-	obs_source_update_properties(filter->context);
+	return true;
 }
 
 bool ShowDetectedLuminanceModified(obs_properties_t *props, obs_property_t * /*property*/, obs_data_t *settings)
@@ -521,7 +817,7 @@ bool ShowDetectedLuminanceModified(obs_properties_t *props, obs_property_t * /*p
 	return true;
 }
 
-void UpdateUsageDescription(obs_properties_t *props, SmartGammaMode mode)
+void UpdateUsageDescription(obs_properties_t *props, smart_gamma::SmartGammaMode mode)
 {
 	if (!props)
 		return;
@@ -530,11 +826,11 @@ void UpdateUsageDescription(obs_properties_t *props, SmartGammaMode mode)
 	if (!usage_prop)
 		return;
 
-	const char *token = mode == SmartGammaMode::AutoBrightness ? "SmartGamma.UsageText.Auto"
+	const char *token = mode == smart_gamma::SmartGammaMode::AutoBrightness ? "SmartGamma.UsageText.Auto"
 								   : "SmartGamma.UsageText.Manual";
 	const char *text = obs_module_text(token);
 	if (!text || text[0] == '\0') {
-		text = mode == SmartGammaMode::AutoBrightness
+		text = mode == smart_gamma::SmartGammaMode::AutoBrightness
 			       ? "Auto brightness gradually boosts visibility once scenes drop below the darkness threshold."
 			       : "Threshold fade waits for the threshold delay, fades in, then fades out once scenes brighten.";
 	}
@@ -563,149 +859,549 @@ bool SmartGammaModeModified(obs_properties_t *props, obs_property_t * /*property
 	if (!props || !settings)
 		return false;
 
-	const SmartGammaMode mode = ParseSmartGammaMode(obs_data_get_string(settings, kSmartGammaModeKey));
-	const bool auto_mode = mode == SmartGammaMode::AutoBrightness;
+	const smart_gamma::SmartGammaMode mode = ParseSmartGammaMode(obs_data_get_string(settings, kSmartGammaModeKey));
+	const bool auto_mode = mode == smart_gamma::SmartGammaMode::AutoBrightness;
 	UpdateModeDependentPropertyVisibility(props, auto_mode);
 	UpdateUsageDescription(props, mode);
 	return true;
 }
 
-void UpdateThresholdStateMachine(SmartGammaFilter *filter, float delta_seconds)
+void UploadShaderParams(SmartGammaFilter *filter)
 {
-	if (!filter)
+	if (!filter || !filter->effect)
+		return;
+
+	if (filter->strength_param)
+		gs_effect_set_float(filter->strength_param, filter->render_strength);
+	const RenderSettings &settings = filter->render_settings;
+	if (filter->gamma_param)
+		gs_effect_set_float(filter->gamma_param,
+				    std::max(settings.gamma.load(std::memory_order_relaxed), 0.01f));
+	if (filter->brightness_param)
+		gs_effect_set_float(filter->brightness_param, settings.brightness.load(std::memory_order_relaxed));
+	if (filter->contrast_param)
+		gs_effect_set_float(filter->contrast_param, settings.contrast.load(std::memory_order_relaxed));
+	if (filter->saturation_param)
+		gs_effect_set_float(filter->saturation_param, settings.saturation.load(std::memory_order_relaxed));
+}
+
+// Every enable starts a new `<source>-<timestamp>` session. Deletes all but the newest kMaxTraceSessions - 1 (by the
+// latest file modification time), leaving room for the one about to start.
+void PruneTraceSessions(const std::string &directory)
+{
+	os_dir_t *dir = os_opendir(directory.c_str());
+	if (!dir)
 		return;
 
-	const bool is_dark = filter->smoothed_luminance <= filter->settings.darkness_threshold;
+	struct TraceSession {
+		std::time_t newest = 0;
+		std::vector<std::string> paths;
+	};
+	std::map<std::string, TraceSession> sessions;
+	const std::string extension = smart_gamma::kTraceFileExtension;
+	for (struct os_dirent *entry = os_readdir(dir); entry; entry = os_readdir(dir)) {
+		const std::string name = entry->d_name;
+		const std::size_t dash = name.rfind('-');
+		if (entry->directory || dash == std::string::npos || name.size() <= extension.size() ||
+		    name.compare(name.size() - extension.size(), extension.size(), extension) != 0)
+			continue;
+
+		const std::string path = directory + "/" + name;
+		struct stat info;
+		if (os_stat(path.c_str(), &info) != 0)
+			continue;
+		TraceSession &session = sessions[name.substr(0, dash)];
+		session.newest = std::max(session.newest, static_cast<std::time_t>(info.st_mtime));
+		session.paths.push_back(path);
+	}
+	os_closedir(dir);
+	if (sessions.size() < kMaxTraceSessions)
+		return;
 
-	const float threshold_duration = std::max(filter->settings.threshold_duration_ms / 1000.0f, 0.0f);
-	const float fade_in_seconds = std::max(filter->settings.fade_in_ms / 1000.0f, 0.0001f);
-	const float fade_out_seconds = std::max(filter->settings.fade_out_ms / 1000.0f, 0.0001f);
+	std::vector<const TraceSession *> ordered;
+	for (const auto &[prefix, session] : sessions)
+		ordered.push_back(&session);
+	std::sort(ordered.begin(), ordered.end(),
+		  [](const TraceSession *a, const TraceSession *b) { return a->newest > b->newest; });
+	for (std::size_t i = kMaxTraceSessions - 1; i < ordered.size(); ++i) {
+		for (const std::string &path : ordered[i]->paths)
+			os_unlink(path.c_str());
+	}
+}
 
-	if (is_dark) {
-		filter->time_below_threshold += delta_seconds;
-		filter->time_above_threshold = 0.0f;
-	} else {
-		filter->time_above_threshold += delta_seconds;
-		filter->time_below_threshold = 0.0f;
-	}
-
-	const bool dark_duration_met = threshold_duration <= 0.0f || filter->time_below_threshold >= threshold_duration;
-	const bool light_duration_met = threshold_duration <= 0.0f ||
-					filter->time_above_threshold >= threshold_duration;
-
-	switch (filter->state) {
-	case SmartGammaState::Idle:
-		filter->effect_strength = 0.0f;
-		if (is_dark) {
-			if (dark_duration_met) {
-				filter->state = SmartGammaState::FadingIn;
-			} else {
-				filter->state = SmartGammaState::WaitingForThreshold;
-			}
-		}
-		break;
-
-	case SmartGammaState::WaitingForThreshold:
-		if (!is_dark) {
-			filter->state = SmartGammaState::Idle;
-			filter->time_below_threshold = 0.0f;
-		} else if (dark_duration_met) {
-			filter->state = SmartGammaState::FadingIn;
-		}
-		break;
-
-	case SmartGammaState::FadingIn:
-		if (!is_dark) {
-			if (light_duration_met) {
-				filter->state = SmartGammaState::FadingOut;
-				break;
-			}
-		}
-		if (is_dark) {
-			filter->effect_strength = clamp01(filter->effect_strength + (delta_seconds / fade_in_seconds));
-			if (filter->effect_strength >= 1.0f - kEpsilon) {
-				filter->effect_strength = 1.0f;
-				filter->state = SmartGammaState::Active;
-			}
+std::string BuildTracePathPrefix(SmartGammaFilter *filter)
+{
+	char *directory = obs_module_config_path("traces");
+	if (!directory)
+		return {};
+	const std::string prefix_directory = directory;
+	bfree(directory);
+	if (os_mkdirs(prefix_directory.c_str()) == MKDIR_ERROR)
+		return {};
+	PruneTraceSessions(prefix_directory);
+
+	obs_source_t *parent = obs_filter_get_parent(filter->context);
+	std::string name = obs_source_get_name(parent ? parent : filter->context);
+	for (char &c : name) {
+		if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_')
+			c = '_';
+	}
+
+	const std::time_t now = std::time(nullptr);
+	char timestamp[32] = {};
+	std::strftime(timestamp, sizeof(timestamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+	return prefix_directory + "/" + name + "-" + timestamp;
+}
+
+// Swapped under controller_mutex so the worker never pushes into a recorder being destroyed.
+void SetTraceRecorder(SmartGammaFilter *filter, smart_gamma::TraceRecorder *recorder)
+{
+	smart_gamma::TraceRecorder *previous = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(filter->controller_mutex);
+		previous = filter->trace_recorder;
+		filter->trace_recorder = recorder;
+	}
+
+	// Drops happen on the worker without any other signal, so a trace with gaps is explained in the log.
+	const uint64_t dropped = smart_gamma::GetDroppedTraceRecords(previous);
+	if (dropped > 0)
+		blog(LOG_WARNING, "Smart Gamma: luminance trace for '%s' dropped %llu records (queue full)",
+		     obs_source_get_name(filter->context), static_cast<unsigned long long>(dropped));
+	smart_gamma::DestroyTraceRecorder(previous);
+}
+
+void UpdateTraceRecorder(SmartGammaFilter *filter, bool enabled)
+{
+	if (!filter || enabled == (filter->trace_recorder != nullptr))
+		return;
+
+	if (!enabled) {
+		SetTraceRecorder(filter, nullptr);
+		return;
+	}
+
+	smart_gamma::TraceRecorderOptions options;
+	options.path_prefix = BuildTracePathPrefix(filter);
+	obs_source_t *parent = obs_filter_get_parent(filter->context);
+	options.source_name = obs_source_get_name(parent ? parent : filter->context);
+	smart_gamma::TraceRecorder *recorder =
+		options.path_prefix.empty() ? nullptr : smart_gamma::CreateTraceRecorder(options);
+	if (!recorder) {
+		blog(LOG_WARNING, "Smart Gamma: failed to start luminance trace at %s", options.path_prefix.c_str());
+		return;
+	}
+
+	blog(LOG_INFO, "Smart Gamma: recording luminance trace to %s-*%s", options.path_prefix.c_str(),
+	     smart_gamma::kTraceFileExtension);
+	SetTraceRecorder(filter, recorder);
+}
+
+void RecordTrace(SmartGammaFilter *filter, const LuminanceJob &job)
+{
+	smart_gamma::TraceRecord record = {};
+	record.timestamp_ns = job.timestamp_ns;
+	record.raw_luminance = filter->latest_luminance;
+	record.smoothed_luminance = filter->controller.smoothed_luminance;
+	record.effect_strength = filter->controller.effect_strength;
+	record.probe_cost_ns =
+		static_cast<uint32_t>(std::min<uint64_t>(job.probe_cost_ns, std::numeric_limits<uint32_t>::max()));
+	record.state = static_cast<uint8_t>(filter->controller.state);
+	record.mode = static_cast<uint8_t>(filter->settings.mode);
+	record.probe_size = static_cast<uint16_t>(job.probe_size);
+	smart_gamma::PushTraceRecord(filter->trace_recorder, record);
+}
+
+// Worker half of a probe: reduction, smoothing and the controller, then the strength is published for the graphics
+// thread.
+void ProcessLuminanceJobs(void *data)
+{
+	auto *filter = static_cast<SmartGammaFilter *>(data);
+	{
+		std::lock_guard<std::mutex> lock(filter->mailbox_mutex);
+		if (!filter->job_posted)
+			return;
+		std::swap(filter->posted_job, filter->worker_job);
+		filter->job_posted = false;
+	}
+
+	const uint64_t start_ns = os_gettime_ns();
+	const LuminanceJob &job = filter->worker_job;
+	float luminance = job.luminance;
+	if (job.has_readback)
+		luminance = smart_gamma::ReduceProbeReadback(job.readback);
+
+	bool refresh_properties = false;
+	{
+		std::lock_guard<std::mutex> lock(filter->controller_mutex);
+		if (job.has_readback || job.has_luminance) {
+			StoreSampledLuminance(filter, luminance, job.extended_range);
+			smart_gamma::PublishSharedMeter(job.meter.get(), filter, filter->latest_luminance,
+							job.extended_range, job.timestamp_ns);
 		}
-		break;
 
-	case SmartGammaState::Active:
-		filter->effect_strength = 1.0f;
-		if (!is_dark && light_duration_met)
-			filter->state = SmartGammaState::FadingOut;
-		break;
+		// The controller used to step once per rendered frame. It still takes one step per frame of the
+		// interval that just ended, but all with the new sample, so the published value is where the per-frame
+		// controller would be one interval from now; the graphics thread eases toward it over that interval.
+		const uint32_t frames = std::max(job.frames, 1u);
+		const float step_seconds = job.interval_seconds / static_cast<float>(frames);
+		for (uint32_t i = 0; i < frames; ++i)
+			smart_gamma::UpdateController(&filter->controller, filter->settings, step_seconds,
+						      filter->latest_luminance);
+
+		refresh_properties = UpdateLuminanceDisplay(filter);
+		if (filter->trace_recorder)
+			RecordTrace(filter, job);
+		PublishStrength(filter);
+		filter->stats.state.store(static_cast<uint8_t>(filter->controller.state), std::memory_order_relaxed);
+	}
 
-	case SmartGammaState::FadingOut:
-		if (is_dark && dark_duration_met) {
-			filter->state = SmartGammaState::FadingIn;
-			break;
+	InstanceStats &stats = filter->stats;
+	if (job.interval_seconds > 0.0f) {
+		const float rate = 1.0f / job.interval_seconds;
+		const float previous = stats.probe_rate_hz.load(std::memory_order_relaxed);
+		stats.probe_rate_hz.store(previous <= 0.0f ? rate : previous + (rate - previous) * kProbeRateSmoothing,
+					  std::memory_order_relaxed);
+	}
+	stats.probes.fetch_add(1, std::memory_order_relaxed);
+	stats.worker_ns.fetch_add(os_gettime_ns() - start_ns, std::memory_order_relaxed);
+
+	if (refresh_properties)
+		obs_source_update_properties(filter->context);
+}
+
+// Eases the strength uniform toward the value the worker published last, over one probe interval. The first value
+// (creation or warm start) is applied as is.
+void AdvanceRenderStrength(SmartGammaFilter *filter, float delta)
+{
+	const uint64_t published = filter->published_strength.load(std::memory_order_acquire);
+	const auto sequence = static_cast<uint32_t>(published >> 32);
+	if (sequence != filter->applied_sequence) {
+		const auto bits = static_cast<uint32_t>(published);
+		float target = 0.0f;
+		std::memcpy(&target, &bits, sizeof(target));
+		filter->strength_from = filter->applied_sequence == 0 ? target : filter->render_strength;
+		filter->strength_to = target;
+		filter->strength_progress = 0.0f;
+		filter->applied_sequence = sequence;
+	}
+
+	filter->strength_progress =
+		std::min(filter->strength_progress + delta / smart_gamma::kLuminanceSampleIntervalSeconds, 1.0f);
+	filter->render_strength =
+		filter->strength_from + (filter->strength_to - filter->strength_from) * filter->strength_progress;
+}
+
+enum gs_color_space GetSourceColorSpace(SmartGammaFilter *filter)
+{
+	obs_source_t *target = filter && filter->context ? obs_filter_get_target(filter->context) : nullptr;
+	if (!target)
+		return GS_CS_SRGB;
+
+	const enum gs_color_space preferred_spaces[] = {GS_CS_SRGB, GS_CS_SRGB_16F, GS_CS_709_EXTENDED};
+	return obs_source_get_color_space(target, OBS_COUNTOF(preferred_spaces), preferred_spaces);
+}
+
+const char *GetDrawTechnique(enum gs_color_space space)
+{
+	switch (space) {
+	case GS_CS_SRGB_16F:
+		return "DrawLinear";
+	case GS_CS_709_EXTENDED:
+		return "DrawLinearExtended";
+	default:
+		return "Draw";
+	}
+}
+
+// Advances the probe timer by one frame and sets the uniforms; when a probe is due, `capture` fills the staged job
+// and it is posted to the worker. A job waiting for its atlas tile is posted by the atlas instead, and the next probe
+// waits until then.
+template<typename Capture> void AdvanceFrame(SmartGammaFilter *filter, float delta, Capture &&capture)
+{
+	filter->time_since_last_sample += delta;
+	++filter->frames_since_last_sample;
+
+	bool should_sample_luminance = false;
+	if (!filter->staged_job.awaiting_atlas) {
+		const bool probe_requested = filter->probe_requested.exchange(false, std::memory_order_relaxed);
+		should_sample_luminance =
+			!filter->luminance_initialized.load(std::memory_order_relaxed) || probe_requested ||
+			filter->time_since_last_sample >= smart_gamma::kLuminanceSampleIntervalSeconds;
+	}
+	if (should_sample_luminance) {
+		LuminanceJob &job = filter->staged_job;
+		job.has_readback = false;
+		job.has_luminance = false;
+		job.meter.reset();
+		job.frames = filter->frames_since_last_sample;
+		job.interval_seconds = filter->time_since_last_sample;
+		capture(job);
+		if (!job.awaiting_atlas)
+			PostLuminanceJob(filter);
+		filter->time_since_last_sample = 0.0f;
+		filter->frames_since_last_sample = 0;
+	}
+
+	AdvanceRenderStrength(filter, delta);
+	UploadShaderParams(filter);
+}
+
+void CaptureProgramLuminance(SmartGammaFilter *filter, gs_texture_t *program, enum gs_color_space space,
+			     LuminanceJob &job)
+{
+	uint32_t size = filter->render_settings.probe_resolution.load(std::memory_order_relaxed);
+	if (size == smart_gamma::kProbeResolutionAuto)
+		size = smart_gamma::SelectAutoProbeSize(&filter->probe, gs_texture_get_width(program),
+							gs_texture_get_height(program));
+
+	if (smart_gamma::CaptureTextureProbe(&filter->probe, program, space, size, &job.readback))
+		SetCapturedProbe(job, nullptr);
+}
+
+// The program texture cannot be sampled while it is the render target, so it is copied once and drawn back through
+// the correction technique in a single full-frame pass.
+void DrawProgramCorrection(SmartGammaFilter *filter, gs_texture_t *program, enum gs_color_space space)
+{
+	const uint32_t width = gs_texture_get_width(program);
+	const uint32_t height = gs_texture_get_height(program);
+	const enum gs_color_format format = gs_texture_get_color_format(program);
+	if (filter->program_copy &&
+	    (gs_texture_get_width(filter->program_copy) != width ||
+	     gs_texture_get_height(filter->program_copy) != height ||
+	     gs_texture_get_color_format(filter->program_copy) != format)) {
+		gs_texture_destroy(filter->program_copy);
+		filter->program_copy = nullptr;
+	}
+	if (!filter->program_copy)
+		filter->program_copy = gs_texture_create(width, height, format, 1, nullptr, GS_RENDER_TARGET);
+	if (!filter->program_copy)
+		return;
+	gs_copy_texture(filter->program_copy, program);
+
+	gs_texture_t *previous_target = gs_get_render_target();
+	gs_zstencil_t *previous_zstencil = gs_get_zstencil_target();
+	const enum gs_color_space previous_space = gs_get_color_space();
+	const bool previous_srgb = gs_framebuffer_srgb_enabled();
+
+	gs_viewport_push();
+	gs_projection_push();
+	gs_matrix_push();
+	gs_matrix_identity();
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+	gs_enable_framebuffer_srgb(false);
+
+	gs_set_render_target_with_color_space(program, nullptr, space);
+	gs_set_viewport(0, 0, static_cast<int>(width), static_cast<int>(height));
+	gs_ortho(0.0f, static_cast<float>(width), 0.0f, static_cast<float>(height), -100.0f, 100.0f);
+	gs_effect_set_texture(filter->image_param, filter->program_copy);
+	while (gs_effect_loop(filter->effect, GetDrawTechnique(space)))
+		gs_draw_sprite(filter->program_copy, 0, width, height);
+
+	gs_enable_framebuffer_srgb(previous_srgb);
+	gs_blend_state_pop();
+	gs_matrix_pop();
+	gs_projection_pop();
+	gs_viewport_pop();
+	gs_set_render_target_with_color_space(previous_target, previous_zstencil, previous_space);
+}
+
+// Runs on the graphics thread after the main view has been composited and before it is converted for the encoders.
+void SmartGammaProgramRendered(void *data)
+{
+	auto *filter = static_cast<SmartGammaFilter *>(data);
+	gs_texture_t *program = obs_get_main_texture();
+	if (!filter->effect || !program)
+		return;
+
+	// The parent source may not be ticking or rendering at all, so the frame time is measured here.
+	const uint64_t now_ns = os_gettime_ns();
+	float delta = 1.0f / 60.0f;
+	if (filter->program_last_frame_ns != 0)
+		delta = std::min(static_cast<float>(now_ns - filter->program_last_frame_ns) / 1e9f, 0.25f);
+	filter->program_last_frame_ns = now_ns;
+
+	const enum gs_color_space space =
+		gs_texture_get_color_format(program) == GS_RGBA16F ? GS_CS_709_EXTENDED : GS_CS_SRGB;
+	AdvanceFrame(filter, delta, [&](LuminanceJob &job) { CaptureProgramLuminance(filter, program, space, job); });
+
+	// At zero strength the corrected frame equals the input; skip the copy and the pass.
+	if (filter->render_strength > smart_gamma::kEpsilon)
+		DrawProgramCorrection(filter, program, space);
+}
+
+void UpdateProgramScope(SmartGammaFilter *filter, bool enabled)
+{
+	if (enabled && !filter->owns_program_output) {
+		SmartGammaFilter *expected = nullptr;
+		if (program_output_owner.compare_exchange_strong(expected, filter)) {
+			filter->owns_program_output = true;
+			filter->program_last_frame_ns = 0;
+			obs_add_main_rendered_callback(SmartGammaProgramRendered, filter);
+		} else if (!filter->program_scope.load(std::memory_order_relaxed)) {
+			blog(LOG_WARNING, "Smart Gamma: another filter owns the program output; '%s' stays inactive",
+			     obs_source_get_name(filter->context));
 		}
-		filter->effect_strength = clamp01(filter->effect_strength - (delta_seconds / fade_out_seconds));
-		if (filter->effect_strength <= kEpsilon) {
-			filter->effect_strength = 0.0f;
-			filter->state = SmartGammaState::Idle;
+	} else if (!enabled && filter->owns_program_output) {
+		// Removal waits for a running callback, so the filter can be destroyed right after.
+		obs_remove_main_rendered_callback(SmartGammaProgramRendered, filter);
+		filter->owns_program_output = false;
+		program_output_owner.store(nullptr);
+	}
+	filter->program_scope.store(enabled, std::memory_order_relaxed);
+}
+
+void ReleaseSidechain(SmartGammaFilter *filter)
+{
+	if (filter->sidechain_source) {
+		obs_source_t *source = obs_weak_source_get_source(filter->sidechain_source);
+		if (source) {
+			obs_source_dec_showing(source);
+			obs_source_release(source);
 		}
-		break;
+		obs_weak_source_release(filter->sidechain_source);
+		filter->sidechain_source = nullptr;
 	}
+	filter->sidechain_meter.reset();
 }
 
-void UpdateAutoBrightnessStrength(SmartGammaFilter *filter, float delta_seconds)
+// Binds the sidechain source by name on the video thread, retrying once a second while it does not exist (scene
+// collection still loading, source renamed or deleted).
+void UpdateSidechain(SmartGammaFilter *filter, float seconds)
 {
-	if (!filter)
-		return;
+	std::string name;
+	bool dirty = false;
+	{
+		std::lock_guard<std::mutex> lock(filter->sidechain_mutex);
+		name = filter->sidechain_name;
+		dirty = filter->sidechain_dirty;
+		filter->sidechain_dirty = false;
+	}
 
-	filter->time_above_threshold = 0.0f;
-	filter->time_below_threshold = 0.0f;
+	if (filter->sidechain_source && obs_weak_source_expired(filter->sidechain_source))
+		dirty = true;
+	if (dirty) {
+		ReleaseSidechain(filter);
+		filter->sidechain_retry_seconds = 0.0f;
+	}
+	if (name.empty() || filter->sidechain_source)
+		return;
 
-	const float threshold = std::max(filter->settings.darkness_threshold, kMinAutoBrightnessThreshold);
-	float target_strength = 0.0f;
-	if (filter->smoothed_luminance < threshold)
-		target_strength = clamp01(1.0f - (filter->smoothed_luminance / threshold));
+	filter->sidechain_retry_seconds -= seconds;
+	if (filter->sidechain_retry_seconds > 0.0f)
+		return;
+	filter->sidechain_retry_seconds = kSidechainRetrySeconds;
 
-	const float response = 1.0f - std::exp(-delta_seconds * kAutoStrengthResponseRate);
-	filter->effect_strength = lerp(filter->effect_strength, target_strength, clamp01(response));
+	obs_source_t *source = obs_get_source_by_name(name.c_str());
+	if (!source)
+		return;
 
-	if (filter->effect_strength <= kEpsilon && target_strength <= kEpsilon) {
-		filter->state = SmartGammaState::Idle;
-	} else {
-		filter->state = SmartGammaState::Active;
+	const char *uuid = obs_source_get_uuid(source);
+	if (source != obs_filter_get_parent(filter->context) && uuid) {
+		// Keep the sidechain rendering (and async sources decoding) even when it is not visible in the program.
+		obs_source_inc_showing(source);
+		filter->sidechain_source = obs_source_get_weak_source(source);
+		filter->sidechain_meter = smart_gamma::AcquireSharedMeter(uuid);
 	}
+	obs_source_release(source);
 }
 
-void UpdateEffectStrength(SmartGammaFilter *filter, float delta_seconds, float luminance)
+#ifdef SMART_GAMMA_HAVE_LOOKAHEAD
+// Path of the local file the parent plays, or empty when the parent is not a media source reading one.
+std::string GetLocalMediaPath(obs_source_t *parent)
 {
-	if (!filter)
+	const char *id = parent ? obs_source_get_id(parent) : nullptr;
+	if (!id || std::strcmp(id, "ffmpeg_source") != 0)
+		return {};
+
+	obs_data_t *settings = obs_source_get_settings(parent);
+	std::string path;
+	if (settings && obs_data_get_bool(settings, "is_local_file"))
+		path = obs_data_get_string(settings, "local_file");
+	obs_data_release(settings);
+	return path;
+}
+
+void SetLookaheadPath(SmartGammaFilter *filter, const std::string &path)
+{
+	if (path == filter->lookahead_path)
 		return;
 
-	if (delta_seconds <= 0.0f)
-		delta_seconds = 1.0f / 60.0f;
+	// Never waits for the analyze thread, which may be blocked in file I/O; it winds down on its own.
+	smart_gamma::StopLookahead(filter->lookahead);
+	filter->lookahead = nullptr;
+	filter->lookahead_path = path;
+	if (path.empty())
+		return;
 
-	filter->smoothed_luminance = lerp(filter->smoothed_luminance, luminance, clamp01(kLuminanceSmoothing));
+	smart_gamma::LookaheadOptions options;
+	options.file_path = path;
+	char *cache_dir = obs_module_config_path("lookahead");
+	if (cache_dir) {
+		options.cache_dir = cache_dir;
+		bfree(cache_dir);
+	}
+	filter->lookahead = smart_gamma::StartLookahead(options);
+}
 
-	if (IsAutoBrightnessMode(filter))
-		UpdateAutoBrightnessStrength(filter, delta_seconds);
-	else
-		UpdateThresholdStateMachine(filter, delta_seconds);
+// Follows the parent's file once a second on the video thread, so switching files or toggling the option restarts
+// the analysis without a settings callback on the media source. The timeline describes the decoded file, so it is only
+// used when this filter sees the file as decoded: no filter before this one and an SDR render. Otherwise the GPU probe
+// meters what actually reaches the filter.
+void UpdateLookahead(SmartGammaFilter *filter, float seconds)
+{
+	filter->lookahead_check_seconds -= seconds;
+	if (filter->lookahead_recheck.exchange(false, std::memory_order_relaxed))
+		filter->lookahead_check_seconds = 0.0f;
+	if (filter->lookahead_check_seconds > 0.0f)
+		return;
+	filter->lookahead_check_seconds = kLookaheadCheckSeconds;
 
-	MaybeUpdateLuminanceDisplay(filter);
+	obs_source_t *parent = obs_filter_get_parent(filter->context);
+	const bool enabled = filter->lookahead_enabled.load(std::memory_order_relaxed) &&
+			     !filter->program_scope.load(std::memory_order_relaxed) && parent &&
+			     obs_filter_get_target(filter->context) == parent &&
+			     GetSourceColorSpace(filter) == GS_CS_SRGB;
+	SetLookaheadPath(filter, enabled ? GetLocalMediaPath(parent) : std::string());
 }
+#endif
 
-void UploadShaderParams(SmartGammaFilter *filter)
+void HandleFilterRename(void *data, calldata_t *call_data)
 {
-	if (!filter || !filter->effect)
+	auto *filter = static_cast<SmartGammaFilter *>(data);
+	const char *name = calldata_string(call_data, "new_name");
+	std::lock_guard<std::mutex> lock(filter->names_mutex);
+	filter->filter_name = name ? name : "";
+}
+
+void HandleParentRename(void *data, calldata_t *call_data)
+{
+	auto *filter = static_cast<SmartGammaFilter *>(data);
+	const char *name = calldata_string(call_data, "new_name");
+	std::lock_guard<std::mutex> lock(filter->names_mutex);
+	filter->parent_name = name ? name : "";
+}
+
+// Follows the parent's name for the stats query; pass nullptr when the filter leaves it. Disconnecting waits for a
+// rename callback in progress, so none runs once this returns.
+void BindParentName(SmartGammaFilter *filter, obs_source_t *parent)
+{
+	if (filter->named_parent == parent)
 		return;
 
-	if (filter->strength_param)
-		gs_effect_set_float(filter->strength_param, clamp01(filter->effect_strength));
-	if (filter->gamma_param)
-		gs_effect_set_float(filter->gamma_param, std::max(filter->settings.gamma, 0.01f));
-	if (filter->brightness_param)
-		gs_effect_set_float(filter->brightness_param, filter->settings.brightness);
-	if (filter->contrast_param)
-		gs_effect_set_float(filter->contrast_param, filter->settings.contrast);
-	if (filter->saturation_param)
-		gs_effect_set_float(filter->saturation_param, filter->settings.saturation);
+	if (filter->named_parent)
+		signal_handler_disconnect(obs_source_get_signal_handler(filter->named_parent), "rename",
+					  HandleParentRename, filter);
+	filter->named_parent = parent;
+
+	const char *name = parent ? obs_source_get_name(parent) : nullptr;
+	{
+		std::lock_guard<std::mutex> lock(filter->names_mutex);
+		filter->parent_name = name ? name : "";
+	}
+	if (parent)
+		signal_handler_connect(obs_source_get_signal_handler(parent), "rename", HandleParentRename, filter);
 }
 
 const char *SmartGammaGetName(void * /*unused*/)
@@ -717,7 +1413,6 @@ void *SmartGammaCreate(obs_data_t *settings, obs_source_t *source)
 {
 	auto *filter = new SmartGammaFilter();
 	filter->context = source;
-	filter->downsample_size = kDefaultDownsampleSize;
 	ResetState(filter);
 
 	if (!CreateGraphicsResources(filter)) {
@@ -726,13 +1421,47 @@ void *SmartGammaCreate(obs_data_t *settings, obs_source_t *source)
 		return nullptr;
 	}
 
+	filter->analysis_task = smart_gamma::RegisterAnalysisTask(ProcessLuminanceJobs, filter);
+	const char *name = obs_source_get_name(source);
+	filter->filter_name = name ? name : "";
+	signal_handler_connect(obs_source_get_signal_handler(source), "rename", HandleFilterRename, filter);
 	UpdateSettingsFromObs(filter, settings);
+	ApplyWarmStartFromSettings(filter, settings);
+	UpdateTraceRecorder(filter, obs_data_get_bool(settings, kTraceEnabledKey));
+	UpdateProgramScope(filter, std::strcmp(obs_data_get_string(settings, kScopeKey), kScopeValueProgram) == 0);
+#ifdef SMART_GAMMA_HAVE_LOOKAHEAD
+	filter->lookahead_enabled.store(obs_data_get_bool(settings, kLookaheadKey), std::memory_order_relaxed);
+#endif
+
+	std::lock_guard<std::mutex> lock(instance_registry_mutex);
+	instance_registry.push_back(filter);
 	return filter;
 }
 
 void SmartGammaDestroy(void *data)
 {
 	auto *filter = static_cast<SmartGammaFilter *>(data);
+	if (filter) {
+		std::lock_guard<std::mutex> lock(instance_registry_mutex);
+		instance_registry.erase(std::remove(instance_registry.begin(), instance_registry.end(), filter),
+					instance_registry.end());
+	}
+	if (filter && filter->context)
+		StoreWarmStart(filter, obs_filter_get_parent(filter->context));
+	if (filter) {
+		UpdateProgramScope(filter, false);
+		// Before the task goes away: the atlas posts results to it.
+		ReleaseAtlasTile(filter);
+		smart_gamma::UnregisterAnalysisTask(filter->analysis_task);
+		SetTraceRecorder(filter, nullptr);
+		ReleaseSidechain(filter);
+#ifdef SMART_GAMMA_HAVE_LOOKAHEAD
+		smart_gamma::StopLookahead(filter->lookahead);
+#endif
+		BindParentName(filter, nullptr);
+		signal_handler_disconnect(obs_source_get_signal_handler(filter->context), "rename",
+					  HandleFilterRename, filter);
+	}
 	DestroyGraphicsResources(filter);
 	delete filter;
 }
@@ -740,12 +1469,61 @@ void SmartGammaDestroy(void *data)
 void SmartGammaUpdate(void *data, obs_data_t *settings)
 {
 	auto *filter = static_cast<SmartGammaFilter *>(data);
+	if (!filter)
+		return;
+
 	UpdateSettingsFromObs(filter, settings);
-	if (filter) {
-		filter->luminance_initialized = false;
-		filter->pending_tick_delta = 0.0f;
-		filter->time_since_last_sample = 0.0f;
+	ApplyWarmStartFromSettings(filter, settings);
+	UpdateTraceRecorder(filter, obs_data_get_bool(settings, kTraceEnabledKey));
+	UpdateProgramScope(filter, std::strcmp(obs_data_get_string(settings, kScopeKey), kScopeValueProgram) == 0);
+#ifdef SMART_GAMMA_HAVE_LOOKAHEAD
+	filter->lookahead_enabled.store(obs_data_get_bool(settings, kLookaheadKey), std::memory_order_relaxed);
+	filter->lookahead_recheck.store(true, std::memory_order_relaxed);
+#endif
+}
+
+void SmartGammaSave(void *data, obs_data_t *settings)
+{
+	auto *filter = static_cast<SmartGammaFilter *>(data);
+	if (!filter || !settings || !filter->luminance_initialized.load(std::memory_order_relaxed))
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(filter->controller_mutex);
+		obs_data_set_double(settings, kCachedLuminanceKey,
+				    static_cast<double>(filter->controller.smoothed_luminance));
+		obs_data_set_double(settings, kCachedStrengthKey,
+				    static_cast<double>(filter->controller.effect_strength));
 	}
+	StoreWarmStart(filter, obs_filter_get_parent(filter->context));
+}
+
+void SmartGammaFilterAdd(void *data, obs_source_t *source)
+{
+	auto *filter = static_cast<SmartGammaFilter *>(data);
+	ApplyWarmStartFromCache(filter, source);
+	BindParentName(filter, source);
+}
+
+void SmartGammaFilterRemove(void *data, obs_source_t *source)
+{
+	auto *filter = static_cast<SmartGammaFilter *>(data);
+	StoreWarmStart(filter, source);
+	BindParentName(filter, nullptr);
+}
+
+void SmartGammaActivate(void *data)
+{
+	auto *filter = static_cast<SmartGammaFilter *>(data);
+	if (filter)
+		filter->probe_requested.store(true, std::memory_order_relaxed);
+}
+
+void SmartGammaDeactivate(void *data)
+{
+	auto *filter = static_cast<SmartGammaFilter *>(data);
+	if (filter && filter->context)
+		StoreWarmStart(filter, obs_filter_get_parent(filter->context));
 }
 
 void SmartGammaTick(void *data, float seconds)
@@ -754,36 +1532,60 @@ void SmartGammaTick(void *data, float seconds)
 	if (!filter)
 		return;
 	filter->pending_tick_delta += seconds;
+	UpdateSidechain(filter, seconds);
+	if (filter->program_scope.load(std::memory_order_relaxed) ||
+	    filter->render_settings.probe_resolution.load(std::memory_order_relaxed) !=
+		    smart_gamma::kProbeResolutionAuto)
+		ReleaseAtlasTile(filter);
+#ifdef SMART_GAMMA_HAVE_LOOKAHEAD
+	UpdateLookahead(filter, seconds);
+#endif
 }
 
 void SmartGammaRender(void *data, gs_effect_t * /*effect*/)
 {
 	auto *filter = static_cast<SmartGammaFilter *>(data);
-	if (!filter || !filter->effect) {
+	if (!filter || !filter->effect || filter->program_scope.load(std::memory_order_relaxed)) {
 		if (filter && filter->context)
 			obs_source_skip_video_filter(filter->context);
 		return;
 	}
 
-	if (!obs_source_process_filter_begin(filter->context, GS_RGBA, OBS_ALLOW_DIRECT_RENDERING))
+	// Process in the source's own space so linear and HDR sources skip the 8-bit round-trip.
+	const enum gs_color_space source_space = GetSourceColorSpace(filter);
+	const enum gs_color_format format = gs_get_format_from_space(source_space);
+	if (!obs_source_process_filter_begin_with_color_space(filter->context, format, source_space,
+							       OBS_ALLOW_DIRECT_RENDERING))
 		return;
 
 	float delta = filter->pending_tick_delta;
 	if (delta <= 0.0f)
 		delta = 1.0f / 60.0f;
 	filter->pending_tick_delta = 0.0f;
-	filter->time_since_last_sample += delta;
+	AdvanceFrame(filter, delta, [filter](LuminanceJob &job) { CaptureLuminance(filter, job); });
 
-	const bool should_sample_luminance = !filter->luminance_initialized ||
-					     filter->time_since_last_sample >= kLuminanceSampleIntervalSeconds;
-	const float luminance = should_sample_luminance ? SampleLuminance(filter) : filter->latest_luminance;
-	if (should_sample_luminance)
-		filter->time_since_last_sample = 0.0f;
+	obs_source_process_filter_tech_end(filter->context, filter->effect, 0, 0, GetDrawTechnique(source_space));
+}
 
-	UpdateEffectStrength(filter, delta, luminance);
-	UploadShaderParams(filter);
+enum gs_color_space SmartGammaGetColorSpace(void *data, size_t /*count*/,
+					    const enum gs_color_space * /*preferred_spaces*/)
+{
+	return GetSourceColorSpace(static_cast<SmartGammaFilter *>(data));
+}
+
+struct SidechainListContext {
+	obs_property_t *property;
+	obs_source_t *parent;
+};
 
-	obs_source_process_filter_end(filter->context, filter->effect, 0, 0);
+bool AddSidechainCandidate(void *data, obs_source_t *source)
+{
+	auto *context = static_cast<SidechainListContext *>(data);
+	if (source != context->parent && (obs_source_get_output_flags(source) & OBS_SOURCE_VIDEO) != 0) {
+		const char *name = obs_source_get_name(source);
+		obs_property_list_add_string(context->property, name, name);
+	}
+	return true;
 }
 
 obs_properties_t *SmartGammaProperties(void *data)
@@ -826,12 +1628,22 @@ obs_properties_t *SmartGammaProperties(void *data)
 		const char *format = obs_module_text("SmartGamma.Param.CurrentLuminance.Value");
 		if (!format || format[0] == '\0')
 			format = "Detected brightness: %.1f%%";
-		char buffer[96];
+		char buffer[160];
 		std::snprintf(buffer, sizeof(buffer), format, percent);
+		if (filter && filter->extended_range_source.load(std::memory_order_relaxed)) {
+			// Undo the sRGB encoding the probe applied and scale by the canvas' SDR white level.
+			const float encoded = percent / 100.0f;
+			const float linear = encoded <= 0.04045f ? encoded / 12.92f
+								 : std::pow((encoded + 0.055f) / 1.055f, 2.4f);
+			const float nits = linear * obs_get_video_sdr_white_level();
+			const char *nits_format = obs_module_text("SmartGamma.Param.CurrentLuminance.Nits");
+			const std::size_t length = std::strlen(buffer);
+			std::snprintf(buffer + length, sizeof(buffer) - length, nits_format, nits);
+		}
 		obs_property_set_long_description(current_luminance_prop, buffer);
 		obs_property_set_enabled(current_luminance_prop, false);
 		obs_property_text_set_info_word_wrap(current_luminance_prop, true);
-		const bool visible = filter ? filter->show_detected_luminance : true;
+		const bool visible = filter ? filter->show_detected_luminance.load(std::memory_order_relaxed) : true;
 		obs_property_set_visible(current_luminance_prop, visible);
 	}
 
@@ -859,9 +1671,71 @@ obs_properties_t *SmartGammaProperties(void *data)
 		}
 	}
 
-	const SmartGammaMode initial_mode = filter ? filter->settings.mode : SmartGammaMode::AutoBrightness;
+	const char *probe_label = obs_module_text("SmartGamma.Param.ProbeResolution");
+	obs_property_t *probe_prop = obs_properties_add_list(props, kProbeResolutionKey, probe_label,
+							     OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	if (probe_prop) {
+		obs_property_list_add_int(probe_prop, obs_module_text("SmartGamma.Param.ProbeResolution.Auto"),
+					  smart_gamma::kProbeResolutionAuto);
+		for (const uint32_t size : smart_gamma::kProbeSizes) {
+			char label[32];
+			std::snprintf(label, sizeof(label), "%u × %u", size, size);
+			obs_property_list_add_int(probe_prop, label, size);
+		}
+		obs_property_set_long_description(probe_prop,
+						  obs_module_text("SmartGamma.Param.ProbeResolution.Description"));
+	}
+
+	const char *scope_label = obs_module_text("SmartGamma.Param.Scope");
+	obs_property_t *scope_prop =
+		obs_properties_add_list(props, kScopeKey, scope_label, OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	if (scope_prop) {
+		obs_property_list_add_string(scope_prop, obs_module_text("SmartGamma.Param.Scope.Source"),
+					     kScopeValueSource);
+		obs_property_list_add_string(scope_prop, obs_module_text("SmartGamma.Param.Scope.Program"),
+					     kScopeValueProgram);
+		const bool blocked = filter && filter->program_scope.load(std::memory_order_relaxed) &&
+				     !filter->owns_program_output;
+		obs_property_set_long_description(scope_prop,
+						  obs_module_text(blocked ? "SmartGamma.Param.Scope.Taken"
+									  : "SmartGamma.Param.Scope.Description"));
+	}
+
+	obs_property_t *sidechain_prop =
+		obs_properties_add_list(props, kSidechainSourceKey, obs_module_text("SmartGamma.Param.Sidechain"),
+					OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	if (sidechain_prop) {
+		obs_property_list_add_string(sidechain_prop, obs_module_text("SmartGamma.Param.Sidechain.None"), "");
+		SidechainListContext context{sidechain_prop,
+					     filter && filter->context ? obs_filter_get_parent(filter->context)
+								       : nullptr};
+		obs_enum_scenes(AddSidechainCandidate, &context);
+		obs_enum_sources(AddSidechainCandidate, &context);
+		obs_property_set_long_description(sidechain_prop,
+						  obs_module_text("SmartGamma.Param.Sidechain.Description"));
+	}
+
+#ifdef SMART_GAMMA_HAVE_LOOKAHEAD
+	obs_property_t *lookahead_prop =
+		obs_properties_add_bool(props, kLookaheadKey, obs_module_text("SmartGamma.Param.Lookahead"));
+	if (lookahead_prop)
+		obs_property_set_long_description(lookahead_prop,
+						  obs_module_text("SmartGamma.Param.Lookahead.Description"));
+#endif
+
+	obs_property_t *trace_prop =
+		obs_properties_add_bool(props, kTraceEnabledKey, obs_module_text("SmartGamma.Param.TraceEnabled"));
+	if (trace_prop)
+		obs_property_set_long_description(trace_prop,
+						  obs_module_text("SmartGamma.Param.TraceEnabled.Description"));
+
+	smart_gamma::SmartGammaMode initial_mode = smart_gamma::SmartGammaMode::AutoBrightness;
+	if (filter) {
+		std::lock_guard<std::mutex> lock(filter->controller_mutex);
+		initial_mode = filter->settings.mode;
+	}
 	UpdateUsageDescription(props, initial_mode);
-	UpdateModeDependentPropertyVisibility(props, initial_mode == SmartGammaMode::AutoBrightness);
+	UpdateModeDependentPropertyVisibility(props, initial_mode == smart_gamma::SmartGammaMode::AutoBrightness);
 
 	const std::string plugin_name = obs_module_text("SmartGamma.FilterName");
 	const std::string plugin_info = "<a href=\"" + std::string(SMART_GAMMA_REPO) + "\">" + plugin_name + "</a> v" +
@@ -883,6 +1757,79 @@ void SmartGammaDefaults(obs_data_t *settings)
 	obs_data_set_default_string(settings, kSmartGammaModeKey, kModeValueAuto);
 	obs_data_set_default_bool(settings, kDarknessThresholdPercentKey, true);
 	obs_data_set_default_bool(settings, kShowDetectedLuminanceKey, false);
+	obs_data_set_default_int(settings, kProbeResolutionKey, smart_gamma::kProbeResolutionAuto);
+	obs_data_set_default_bool(settings, kTraceEnabledKey, false);
+	obs_data_set_default_string(settings, kSidechainSourceKey, "");
+	obs_data_set_default_string(settings, kScopeKey, kScopeValueSource);
+	obs_data_set_default_bool(settings, kLookaheadKey, false);
+}
+
+obs_data_t *BuildInstanceStats(SmartGammaFilter *filter)
+{
+	const InstanceStats &stats = filter->stats;
+	obs_data_t *item = obs_data_create();
+
+	{
+		std::lock_guard<std::mutex> lock(filter->names_mutex);
+		obs_data_set_string(item, "source", filter->parent_name.c_str());
+		obs_data_set_string(item, "filter", filter->filter_name.c_str());
+	}
+	const auto mode = static_cast<smart_gamma::SmartGammaMode>(stats.mode.load(std::memory_order_relaxed));
+	obs_data_set_string(item, "mode",
+			    mode == smart_gamma::SmartGammaMode::AutoBrightness ? kModeValueAuto : kModeValueThreshold);
+	obs_data_set_string(item, "scope",
+			    filter->program_scope.load(std::memory_order_relaxed) ? kScopeValueProgram
+										   : kScopeValueSource);
+	obs_data_set_string(item, "state", smart_gamma::TraceStateName(stats.state.load(std::memory_order_relaxed)));
+
+	const uint64_t published = filter->published_strength.load(std::memory_order_acquire);
+	const auto strength_bits = static_cast<uint32_t>(published);
+	float strength = 0.0f;
+	std::memcpy(&strength, &strength_bits, sizeof(strength));
+	obs_data_set_double(item, "strength", static_cast<double>(strength));
+	obs_data_set_double(item, "smoothed_luminance",
+			    static_cast<double>(filter->displayed_luminance_percent.load(std::memory_order_relaxed)) /
+				    100.0);
+	obs_data_set_bool(item, "extended_range", filter->extended_range_source.load(std::memory_order_relaxed));
+
+	const uint64_t probes = stats.probes.load(std::memory_order_relaxed);
+	const uint64_t worker_ns = stats.worker_ns.load(std::memory_order_relaxed);
+	obs_data_set_double(item, "probe_rate_hz",
+			    static_cast<double>(stats.probe_rate_hz.load(std::memory_order_relaxed)));
+	obs_data_set_int(item, "probe_size", stats.probe_size.load(std::memory_order_relaxed));
+	obs_data_set_int(item, "atlas_tile", stats.atlas_tile.load(std::memory_order_relaxed));
+	obs_data_set_int(item, "probes", static_cast<long long>(probes));
+	obs_data_set_int(item, "coalesced_probes",
+			 static_cast<long long>(stats.coalesced_probes.load(std::memory_order_relaxed)));
+	obs_data_set_double(item, "last_probe_cost_ms",
+			    static_cast<double>(stats.last_probe_cost_ns.load(std::memory_order_relaxed)) / 1e6);
+	obs_data_set_double(item, "average_probe_cost_ms",
+			    static_cast<double>(stats.average_probe_cost_ms.load(std::memory_order_relaxed)));
+	obs_data_set_double(item, "average_worker_ms",
+			    probes ? static_cast<double>(worker_ns) / static_cast<double>(probes) / 1e6 : 0.0);
+	return item;
+}
+
+// proc: void smart_gamma_get_stats(out string json). One JSON object with an `instances` array, one entry per live
+// filter. Reads only atomics and the cached names, so it can be polled at any rate without touching the graphics
+// thread.
+void SmartGammaGetStats(void * /*data*/, calldata_t *call_data)
+{
+	obs_data_t *root = obs_data_create();
+	obs_data_array_t *instances = obs_data_array_create();
+	{
+		std::lock_guard<std::mutex> lock(instance_registry_mutex);
+		for (SmartGammaFilter *filter : instance_registry) {
+			obs_data_t *item = BuildInstanceStats(filter);
+			obs_data_array_push_back(instances, item);
+			obs_data_release(item);
+		}
+	}
+	obs_data_set_string(root, "version", SMART_GAMMA_VERSION);
+	obs_data_set_array(root, "instances", instances);
+	calldata_set_string(call_data, "json", obs_data_get_json(root));
+	obs_data_array_release(instances);
+	obs_data_release(root);
 }
 
 obs_source_info BuildSourceInfo()
@@ -897,8 +1844,16 @@ obs_source_info BuildSourceInfo()
 	info.get_defaults = SmartGammaDefaults;
 	info.get_properties = SmartGammaProperties;
 	info.update = SmartGammaUpdate;
+	info.save = SmartGammaSave;
+	info.activate = SmartGammaActivate;
+	info.show = SmartGammaActivate;
+	info.deactivate = SmartGammaDeactivate;
+	info.hide = SmartGammaDeactivate;
+	info.filter_add = SmartGammaFilterAdd;
+	info.filter_remove = SmartGammaFilterRemove;
 	info.video_render = SmartGammaRender;
 	info.video_tick = SmartGammaTick;
+	info.video_get_color_space = SmartGammaGetColorSpace;
 	return info;
 }
 
@@ -914,8 +1869,17 @@ const char *obs_module_description(void)
 bool obs_module_load(void)
 {
 	obs_register_source(&SmartGammaFilterInfo);
+	proc_handler_add(obs_get_proc_handler(), "void smart_gamma_get_stats(out string json)", SmartGammaGetStats,
+			 nullptr);
+	signal_handler_connect(obs_get_signal_handler(), "source_remove", HandleSourceRemoved, nullptr);
 	blog(LOG_INFO, "Smart Gamma filter registered");
 	return true;
 }
 
-void obs_module_unload(void) {}
+void obs_module_unload(void)
+{
+	signal_handler_disconnect(obs_get_signal_handler(), "source_remove", HandleSourceRemoved, nullptr);
+#ifdef SMART_GAMMA_HAVE_LOOKAHEAD
+	smart_gamma::ShutdownLookahead();
+#endif
+}
@@ -0,0 +1,259 @@
+#include "smart-gamma/trace_recorder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+#include <util/platform.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace smart_gamma {
+
+namespace {
+
+constexpr std::size_t kQueueCapacity = 4096;
+constexpr auto kFlushInterval = std::chrono::milliseconds(250);
+
+static_assert((kQueueCapacity & (kQueueCapacity - 1)) == 0, "queue capacity must be a power of two");
+
+struct MappedFile {
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+	uint8_t *data = nullptr;
+	std::size_t size = 0;
+};
+
+void UnmapFile(MappedFile &file)
+{
+#ifdef _WIN32
+	if (file.data)
+		UnmapViewOfFile(file.data);
+	if (file.mapping)
+		CloseHandle(file.mapping);
+	if (file.file != INVALID_HANDLE_VALUE)
+		CloseHandle(file.file);
+	file.file = INVALID_HANDLE_VALUE;
+	file.mapping = nullptr;
+#else
+	if (file.data)
+		munmap(file.data, file.size);
+	if (file.fd >= 0)
+		close(file.fd);
+	file.fd = -1;
+#endif
+	file.data = nullptr;
+	file.size = 0;
+}
+
+bool MapFile(const std::string &path, std::size_t size, MappedFile &file)
+{
+#ifdef _WIN32
+	const int wide_length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+	std::wstring wide_path(static_cast<std::size_t>(std::max(wide_length, 1)), L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, wide_path.data(), wide_length);
+
+	file.file = CreateFileW(wide_path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+				CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file.file == INVALID_HANDLE_VALUE)
+		return false;
+
+	const uint64_t size64 = static_cast<uint64_t>(size);
+	file.mapping = CreateFileMappingW(file.file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size64 >> 32),
+					  static_cast<DWORD>(size64 & 0xFFFFFFFFu), nullptr);
+	if (!file.mapping) {
+		UnmapFile(file);
+		return false;
+	}
+	file.data = static_cast<uint8_t *>(MapViewOfFile(file.mapping, FILE_MAP_WRITE, 0, 0, size));
+#else
+	file.fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file.fd < 0)
+		return false;
+	if (ftruncate(file.fd, static_cast<off_t>(size)) != 0) {
+		UnmapFile(file);
+		return false;
+	}
+	void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file.fd, 0);
+	file.data = mapped == MAP_FAILED ? nullptr : static_cast<uint8_t *>(mapped);
+#endif
+	if (!file.data) {
+		UnmapFile(file);
+		return false;
+	}
+	file.size = size;
+	return true;
+}
+
+} // namespace
+
+struct TraceRecorder {
+	TraceRecorderOptions options;
+
+	std::array<TraceRecord, kQueueCapacity> queue{};
+	std::atomic<uint64_t> head{0};
+	std::atomic<uint64_t> tail{0};
+	std::atomic<uint64_t> dropped{0};
+
+	MappedFile file;
+	uint64_t file_sequence = 0;
+
+	std::mutex wake_mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+	std::thread flush_thread;
+};
+
+namespace {
+
+TraceFileHeader *GetHeader(TraceRecorder *recorder)
+{
+	return reinterpret_cast<TraceFileHeader *>(recorder->file.data);
+}
+
+std::string TraceFilePath(const TraceRecorder *recorder, uint64_t sequence)
+{
+	char suffix[32];
+	std::snprintf(suffix, sizeof(suffix), "-%u%s",
+		      static_cast<unsigned>(sequence % std::max<uint32_t>(recorder->options.max_files, 1)),
+		      kTraceFileExtension);
+	return recorder->options.path_prefix + suffix;
+}
+
+bool OpenTraceFile(TraceRecorder *recorder, uint64_t sequence)
+{
+	UnmapFile(recorder->file);
+
+	const std::size_t record_bytes =
+		static_cast<std::size_t>(recorder->options.records_per_file) * sizeof(TraceRecord);
+	const std::size_t size = sizeof(TraceFileHeader) + record_bytes;
+	if (!MapFile(TraceFilePath(recorder, sequence), size, recorder->file))
+		return false;
+
+	TraceFileHeader *header = GetHeader(recorder);
+	std::memset(header, 0, sizeof(*header));
+	std::memcpy(header->magic, kTraceMagic, sizeof(kTraceMagic));
+	header->version = kTraceVersion;
+	header->record_size = sizeof(TraceRecord);
+	header->capacity = recorder->options.records_per_file;
+	header->file_sequence = sequence;
+	// Back to back, so the exporter can place records (os_gettime_ns) on the wall clock.
+	header->created_monotonic_ns = os_gettime_ns();
+	header->created_unix_ms = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+								std::chrono::system_clock::now().time_since_epoch())
+								.count());
+	std::snprintf(header->source_name, sizeof(header->source_name), "%s", recorder->options.source_name.c_str());
+	recorder->file_sequence = sequence;
+	return true;
+}
+
+void DrainQueue(TraceRecorder *recorder)
+{
+	const uint64_t head = recorder->head.load(std::memory_order_acquire);
+	uint64_t tail = recorder->tail.load(std::memory_order_relaxed);
+
+	while (tail != head && recorder->file.data) {
+		TraceFileHeader *header = GetHeader(recorder);
+		if (header->record_count >= header->capacity) {
+			if (!OpenTraceFile(recorder, recorder->file_sequence + 1))
+				break;
+			header = GetHeader(recorder);
+		}
+
+		auto *records = reinterpret_cast<TraceRecord *>(recorder->file.data + sizeof(TraceFileHeader));
+		records[header->record_count] = recorder->queue[tail & (kQueueCapacity - 1)];
+		++header->record_count;
+		++tail;
+	}
+
+	// Anything left (mapping failed) is discarded so the render thread never blocks on a full queue.
+	if (tail != head) {
+		recorder->dropped.fetch_add(head - tail, std::memory_order_relaxed);
+		tail = head;
+	}
+	recorder->tail.store(tail, std::memory_order_release);
+}
+
+void FlushThread(TraceRecorder *recorder)
+{
+	std::unique_lock<std::mutex> lock(recorder->wake_mutex);
+	while (!recorder->stopping) {
+		recorder->wake.wait_for(lock, kFlushInterval);
+		lock.unlock();
+		DrainQueue(recorder);
+		lock.lock();
+	}
+	lock.unlock();
+	DrainQueue(recorder);
+}
+
+} // namespace
+
+TraceRecorder *CreateTraceRecorder(const TraceRecorderOptions &options)
+{
+	auto *recorder = new TraceRecorder();
+	recorder->options = options;
+	recorder->options.records_per_file = std::max<uint64_t>(options.records_per_file, 1);
+	if (!OpenTraceFile(recorder, 0)) {
+		delete recorder;
+		return nullptr;
+	}
+
+	recorder->flush_thread = std::thread(FlushThread, recorder);
+	return recorder;
+}
+
+void DestroyTraceRecorder(TraceRecorder *recorder)
+{
+	if (!recorder)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(recorder->wake_mutex);
+		recorder->stopping = true;
+	}
+	recorder->wake.notify_one();
+	if (recorder->flush_thread.joinable())
+		recorder->flush_thread.join();
+
+	UnmapFile(recorder->file);
+	delete recorder;
+}
+
+void PushTraceRecord(TraceRecorder *recorder, const TraceRecord &record)
+{
+	if (!recorder)
+		return;
+
+	const uint64_t head = recorder->head.load(std::memory_order_relaxed);
+	if (head - recorder->tail.load(std::memory_order_acquire) >= kQueueCapacity) {
+		recorder->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	recorder->queue[head & (kQueueCapacity - 1)] = record;
+	recorder->head.store(head + 1, std::memory_order_release);
+}
+
+uint64_t GetDroppedTraceRecords(const TraceRecorder *recorder)
+{
+	return recorder ? recorder->dropped.load(std::memory_order_relaxed) : 0;
+}
+
+} // namespace smart_gamma
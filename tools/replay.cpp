@@ -0,0 +1,518 @@
+// Replays luminance traces through the Smart Gamma controller and sweeps parameter grids.
+//
+// Usage: smart-gamma-replay [input] [grid] [options] > sweep.csv
+//
+// Input (one of):
+//   --trace <file.sgtrace>...    recorded traces (rotated files in any order)
+//   --csv <file.csv>             output of smart-gamma-trace-export
+//   --synthetic <pattern>        steps | flicker | ramp | strobe (see --duration, --seed)
+//
+// Grid (each value is a single number, a comma list `a,b,c` or a range `start:stop:step`):
+//   --mode auto|threshold|both   --threshold <percent>   --delay <ms>   --fade-in <ms>   --fade-out <ms>
+//
+// Options:
+//   --fps <n>        simulated render rate (default 60)
+//   --threads <n>    worker threads (default: all cores)
+//   --duration <s>   synthetic trace length (default 600)
+//   --seed <n>       synthetic noise seed (default 1)
+//   --output <file>  write the CSV there instead of stdout
+//
+// Each configuration runs the plugin's own UpdateController() and probe scheduling exactly like the filter does: every
+// probe advances the controller over the interval that just ended with the new sample, and the rendered strength eases
+// toward the result over the next interval. One CSV row of stability metrics per configuration, measured on the
+// rendered strength.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "smart-gamma/controller.hpp"
+#include "trace-reader.hpp"
+
+namespace {
+
+// Strength changes smaller than this are treated as noise when counting direction reversals.
+constexpr float kReversalDeadband = 0.05f;
+// An engagement has reached "full" strength once it is within 1% of that engagement's peak.
+constexpr float kFullStrengthFraction = 0.99f;
+
+struct Sample {
+	double seconds = 0.0;
+	float luminance = 0.0f;
+};
+
+struct Configuration {
+	smart_gamma::SmartGammaSettings settings;
+};
+
+struct Metrics {
+	uint64_t toggles = 0;
+	uint64_t engagements = 0;
+	double time_to_full_ms = 0.0;
+	uint64_t reversals = 0;
+	double oscillation_per_min = 0.0;
+	double active_fraction = 0.0;
+	double mean_strength = 0.0;
+};
+
+struct Options {
+	std::vector<std::string> trace_files;
+	std::string csv_file;
+	std::string synthetic;
+	double duration = 600.0;
+	uint32_t seed = 1;
+	double fps = 60.0;
+	unsigned threads = 0;
+	std::string output;
+
+	std::vector<smart_gamma::SmartGammaMode> modes{smart_gamma::SmartGammaMode::AutoBrightness};
+	std::vector<double> thresholds{smart_gamma::DefaultValue(smart_gamma::Parameter::DarknessThreshold)};
+	std::vector<double> delays{smart_gamma::DefaultValue(smart_gamma::Parameter::ThresholdDurationMs)};
+	std::vector<double> fade_ins{smart_gamma::DefaultValue(smart_gamma::Parameter::FadeInMs)};
+	std::vector<double> fade_outs{smart_gamma::DefaultValue(smart_gamma::Parameter::FadeOutMs)};
+};
+
+bool ParseGrid(const char *text, std::vector<double> &values)
+{
+	values.clear();
+	double start = 0.0, stop = 0.0, step = 0.0;
+	char tail = 0;
+	if (std::sscanf(text, "%lf:%lf:%lf%c", &start, &stop, &step, &tail) == 3) {
+		if (step <= 0.0 || stop < start)
+			return false;
+		for (std::size_t i = 0;; ++i) {
+			const double value = start + step * static_cast<double>(i);
+			if (value > stop + step * 1e-6)
+				break;
+			values.push_back(value);
+		}
+		return true;
+	}
+
+	std::stringstream stream(text);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		char *end = nullptr;
+		const double value = std::strtod(item.c_str(), &end);
+		if (item.empty() || *end != '\0')
+			return false;
+		values.push_back(value);
+	}
+	return !values.empty();
+}
+
+bool LoadTraces(const std::vector<std::string> &paths, std::vector<Sample> &samples)
+{
+	std::vector<smart_gamma_tools::TraceFile> traces;
+	for (const std::string &path : paths) {
+		smart_gamma_tools::TraceFile trace;
+		if (!smart_gamma_tools::ReadTraceFile(path.c_str(), trace))
+			return false;
+		traces.push_back(std::move(trace));
+	}
+	smart_gamma_tools::SortTraceFiles(traces);
+
+	bool have_origin = false;
+	uint64_t origin_ns = 0;
+	for (const smart_gamma_tools::TraceFile &trace : traces) {
+		for (const smart_gamma::TraceRecord &record : trace.records) {
+			if (!have_origin) {
+				origin_ns = record.timestamp_ns;
+				have_origin = true;
+			}
+			const double seconds = static_cast<double>(record.timestamp_ns - origin_ns) / 1e9;
+			samples.push_back({seconds, record.raw_luminance});
+		}
+	}
+	return true;
+}
+
+bool LoadCsv(const std::string &path, std::vector<Sample> &samples)
+{
+	std::ifstream file(path);
+	std::string line;
+	if (!file || !std::getline(file, line)) {
+		std::fprintf(stderr, "cannot read %s\n", path.c_str());
+		return false;
+	}
+
+	int seconds_column = -1;
+	int luminance_column = -1;
+	{
+		std::stringstream header(line);
+		std::string name;
+		for (int column = 0; std::getline(header, name, ','); ++column) {
+			if (name == "seconds")
+				seconds_column = column;
+			else if (name == "raw_luminance")
+				luminance_column = column;
+		}
+	}
+	if (seconds_column < 0 || luminance_column < 0) {
+		std::fprintf(stderr, "%s has no seconds/raw_luminance columns\n", path.c_str());
+		return false;
+	}
+
+	while (std::getline(file, line)) {
+		std::stringstream row(line);
+		std::string field;
+		Sample sample;
+		for (int column = 0; std::getline(row, field, ','); ++column) {
+			if (column == seconds_column)
+				sample.seconds = std::strtod(field.c_str(), nullptr);
+			else if (column == luminance_column)
+				sample.luminance = std::strtof(field.c_str(), nullptr);
+		}
+		samples.push_back(sample);
+	}
+	return true;
+}
+
+// Synthetic patterns are generated at the probe rate, which is all the controller ever sees.
+bool GenerateSynthetic(const std::string &pattern, double duration, uint32_t seed, std::vector<Sample> &samples)
+{
+	std::mt19937 rng(seed);
+	std::normal_distribution<float> noise(0.0f, 0.02f);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	const double interval = smart_gamma::kLuminanceSampleIntervalSeconds;
+	const auto count = static_cast<std::size_t>(duration / interval) + 1;
+
+	double next_flash = 2.0;
+	double flash_end = 0.0;
+	for (std::size_t i = 0; i < count; ++i) {
+		const double t = static_cast<double>(i) * interval;
+		float luminance = 0.0f;
+		if (pattern == "steps") {
+			// 30 s of daylight, 20 s of cave.
+			luminance = std::fmod(t, 50.0) < 30.0 ? 0.6f : 0.1f;
+		} else if (pattern == "flicker") {
+			// Hovers around the default threshold, the worst case for toggling.
+			const double threshold = smart_gamma::DefaultValue(smart_gamma::Parameter::DarknessThreshold);
+			luminance = static_cast<float>(threshold / 100.0 + 0.04 * std::sin(t * 1.7)) + noise(rng);
+		} else if (pattern == "ramp") {
+			// Slow 0.05 <-> 0.7 triangle with a two-minute period.
+			const double phase = std::fmod(t, 120.0) / 60.0;
+			luminance = static_cast<float>(0.05 + 0.65 * (phase < 1.0 ? phase : 2.0 - phase));
+		} else if (pattern == "strobe") {
+			// Dark scene with short muzzle-flash style bursts at random intervals.
+			if (t >= next_flash) {
+				flash_end = t + 0.1;
+				next_flash = t + 0.5 + 3.0 * uniform(rng);
+			}
+			luminance = t < flash_end ? 0.9f : 0.08f;
+		} else {
+			std::fprintf(stderr, "unknown synthetic pattern '%s'\n", pattern.c_str());
+			return false;
+		}
+		if (pattern != "flicker")
+			luminance += noise(rng);
+		samples.push_back({t, std::clamp(luminance, 0.0f, 1.0f)});
+	}
+	return true;
+}
+
+Metrics Simulate(const std::vector<Sample> &samples, const smart_gamma::SmartGammaSettings &settings, double fps)
+{
+	Metrics metrics;
+	const auto delta = static_cast<float>(1.0 / fps);
+	const double duration = samples.back().seconds;
+	const auto frames = static_cast<uint64_t>(duration * fps) + 1;
+
+	// The filter seeds the smoothed value with its first probe.
+	smart_gamma::SmartGammaController controller;
+	controller.smoothed_luminance = samples.front().luminance;
+
+	std::size_t sample_index = 0;
+	float time_since_last_sample = 0.0f;
+	uint32_t frames_since_last_sample = 0;
+	bool sampled = false;
+	float strength_from = 0.0f;
+	float strength_to = 0.0f;
+	float strength_progress = 1.0f;
+
+	bool engaged = false;
+	double engagement_start = 0.0;
+	float engagement_peak = 0.0f;
+	std::vector<std::pair<double, float>> engagement_rises;
+	double time_to_full_total = 0.0;
+
+	int direction = 0;
+	float extreme = 0.0f;
+	uint64_t active_frames = 0;
+	double strength_total = 0.0;
+	float previous_strength = 0.0f;
+
+	auto finish_engagement = [&]() {
+		const float full = engagement_peak * kFullStrengthFraction;
+		for (const auto &[time, strength] : engagement_rises) {
+			if (strength >= full) {
+				time_to_full_total += time - engagement_start;
+				break;
+			}
+		}
+	};
+
+	for (uint64_t frame = 0; frame < frames; ++frame) {
+		const double t = static_cast<double>(frame) / fps;
+
+		// Same order as AdvanceFrame() and ProcessLuminanceJobs(): the first frame always probes, the
+		// controller takes one step per frame of the finished interval with the new sample, and the rendered
+		// strength eases from its current value to the published one (the first one is applied as is).
+		time_since_last_sample += delta;
+		++frames_since_last_sample;
+		if (!sampled || time_since_last_sample >= smart_gamma::kLuminanceSampleIntervalSeconds) {
+			while (sample_index + 1 < samples.size() && samples[sample_index + 1].seconds <= t)
+				++sample_index;
+			const float luminance = samples[sample_index].luminance;
+			const float step_seconds =
+				time_since_last_sample / static_cast<float>(frames_since_last_sample);
+			for (uint32_t i = 0; i < frames_since_last_sample; ++i)
+				smart_gamma::UpdateController(&controller, settings, step_seconds, luminance);
+
+			strength_from = sampled ? previous_strength : controller.effect_strength;
+			strength_to = controller.effect_strength;
+			strength_progress = 0.0f;
+			sampled = true;
+			time_since_last_sample = 0.0f;
+			frames_since_last_sample = 0;
+		}
+
+		strength_progress =
+			std::min(strength_progress + delta / smart_gamma::kLuminanceSampleIntervalSeconds, 1.0f);
+		const float strength = strength_from + (strength_to - strength_from) * strength_progress;
+
+		if ((previous_strength < 0.5f) != (strength < 0.5f))
+			++metrics.toggles;
+
+		if (!engaged && strength > smart_gamma::kEpsilon) {
+			engaged = true;
+			engagement_start = t;
+			engagement_peak = 0.0f;
+			engagement_rises.clear();
+			++metrics.engagements;
+		} else if (engaged && strength <= smart_gamma::kEpsilon) {
+			engaged = false;
+			finish_engagement();
+		}
+		if (engaged && strength > engagement_peak) {
+			engagement_peak = strength;
+			engagement_rises.emplace_back(t, strength);
+		}
+
+		if (direction >= 0 && strength > extreme) {
+			extreme = strength;
+			direction = 1;
+		} else if (direction <= 0 && strength < extreme) {
+			extreme = strength;
+			direction = -1;
+		} else if (std::fabs(strength - extreme) > kReversalDeadband) {
+			++metrics.reversals;
+			direction = -direction;
+			extreme = strength;
+		}
+
+		if (strength > smart_gamma::kEpsilon)
+			++active_frames;
+		strength_total += strength;
+		previous_strength = strength;
+	}
+	if (engaged)
+		finish_engagement();
+
+	const double minutes = std::max(duration, 1e-9) / 60.0;
+	metrics.time_to_full_ms = metrics.engagements ? 1000.0 * time_to_full_total / metrics.engagements : 0.0;
+	metrics.oscillation_per_min = static_cast<double>(metrics.reversals) / minutes;
+	metrics.active_fraction = static_cast<double>(active_frames) / static_cast<double>(frames);
+	metrics.mean_strength = strength_total / static_cast<double>(frames);
+	return metrics;
+}
+
+std::vector<Configuration> BuildGrid(const Options &options)
+{
+	std::vector<Configuration> grid;
+	for (smart_gamma::SmartGammaMode mode : options.modes)
+		for (double threshold : options.thresholds)
+			for (double delay : options.delays)
+				for (double fade_in : options.fade_ins)
+					for (double fade_out : options.fade_outs) {
+						Configuration configuration;
+						smart_gamma::SmartGammaSettings &settings = configuration.settings;
+						settings.mode = mode;
+						settings.darkness_threshold = static_cast<float>(threshold / 100.0);
+						settings.threshold_duration_ms = static_cast<float>(delay);
+						settings.fade_in_ms = static_cast<float>(fade_in);
+						settings.fade_out_ms = static_cast<float>(fade_out);
+						grid.push_back(configuration);
+					}
+	return grid;
+}
+
+void PrintUsage(const char *program)
+{
+	std::fprintf(stderr,
+		     "usage: %s (--trace <file>... | --csv <file> | --synthetic steps|flicker|ramp|strobe)\n"
+		     "          [--mode auto|threshold|both] [--threshold <grid>] [--delay <grid>]\n"
+		     "          [--fade-in <grid>] [--fade-out <grid>] [--fps <n>] [--threads <n>]\n"
+		     "          [--duration <s>] [--seed <n>] [--output <file>]\n"
+		     "grid: <value> | <a,b,c> | <start:stop:step>\n",
+		     program);
+}
+
+bool ParseArguments(int argc, char **argv, Options &options)
+{
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		const bool has_value = i + 1 < argc;
+		const char *value = has_value ? argv[i + 1] : "";
+
+		if (arg == "--trace" && has_value) {
+			while (i + 1 < argc && std::strncmp(argv[i + 1], "--", 2) != 0)
+				options.trace_files.push_back(argv[++i]);
+			continue;
+		}
+
+		if (!has_value) {
+			std::fprintf(stderr, "missing value for %s\n", arg.c_str());
+			return false;
+		}
+		++i;
+
+		bool ok = true;
+		if (arg == "--csv") {
+			options.csv_file = value;
+		} else if (arg == "--synthetic") {
+			options.synthetic = value;
+		} else if (arg == "--duration") {
+			options.duration = std::strtod(value, nullptr);
+			ok = options.duration > 0.0;
+		} else if (arg == "--seed") {
+			options.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+		} else if (arg == "--fps") {
+			options.fps = std::strtod(value, nullptr);
+			ok = options.fps > 0.0;
+		} else if (arg == "--threads") {
+			options.threads = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+		} else if (arg == "--output") {
+			options.output = value;
+		} else if (arg == "--mode") {
+			const std::string mode = value;
+			options.modes.clear();
+			if (mode == "auto" || mode == "both")
+				options.modes.push_back(smart_gamma::SmartGammaMode::AutoBrightness);
+			if (mode == "threshold" || mode == "both")
+				options.modes.push_back(smart_gamma::SmartGammaMode::ThresholdTrigger);
+			ok = !options.modes.empty();
+		} else if (arg == "--threshold") {
+			ok = ParseGrid(value, options.thresholds);
+		} else if (arg == "--delay") {
+			ok = ParseGrid(value, options.delays);
+		} else if (arg == "--fade-in") {
+			ok = ParseGrid(value, options.fade_ins);
+		} else if (arg == "--fade-out") {
+			ok = ParseGrid(value, options.fade_outs);
+		} else {
+			std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+			return false;
+		}
+
+		if (!ok) {
+			std::fprintf(stderr, "invalid value '%s' for %s\n", value, arg.c_str());
+			return false;
+		}
+	}
+
+	const int inputs = (options.trace_files.empty() ? 0 : 1) + (options.csv_file.empty() ? 0 : 1) +
+			   (options.synthetic.empty() ? 0 : 1);
+	if (inputs != 1) {
+		std::fprintf(stderr, "exactly one of --trace, --csv or --synthetic is required\n");
+		return false;
+	}
+	return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	Options options;
+	if (!ParseArguments(argc, argv, options)) {
+		PrintUsage(argv[0]);
+		return 2;
+	}
+
+	std::vector<Sample> samples;
+	bool loaded = false;
+	if (!options.trace_files.empty())
+		loaded = LoadTraces(options.trace_files, samples);
+	else if (!options.csv_file.empty())
+		loaded = LoadCsv(options.csv_file, samples);
+	else
+		loaded = GenerateSynthetic(options.synthetic, options.duration, options.seed, samples);
+	if (!loaded)
+		return 1;
+	if (samples.size() < 2) {
+		std::fprintf(stderr, "need at least two luminance samples\n");
+		return 1;
+	}
+
+	const std::vector<Configuration> grid = BuildGrid(options);
+	std::vector<Metrics> results(grid.size());
+
+	unsigned threads = options.threads ? options.threads : std::max(std::thread::hardware_concurrency(), 1u);
+	threads = static_cast<unsigned>(std::min<std::size_t>(threads, grid.size()));
+
+	const auto start = std::chrono::steady_clock::now();
+	std::atomic<std::size_t> next{0};
+	std::vector<std::thread> workers;
+	for (unsigned i = 0; i < threads; ++i) {
+		workers.emplace_back([&]() {
+			for (std::size_t index = next++; index < grid.size(); index = next++)
+				results[index] = Simulate(samples, grid[index].settings, options.fps);
+		});
+	}
+	for (std::thread &worker : workers)
+		worker.join();
+	const double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	FILE *out = stdout;
+	if (!options.output.empty()) {
+		out = std::fopen(options.output.c_str(), "w");
+		if (!out) {
+			std::fprintf(stderr, "cannot write %s\n", options.output.c_str());
+			return 1;
+		}
+	}
+
+	std::fprintf(out, "mode,darkness_threshold_pct,activation_delay_ms,fade_in_ms,fade_out_ms,toggles,engagements,"
+			  "time_to_full_ms,reversals,oscillation_per_min,active_fraction,mean_strength\n");
+	for (std::size_t i = 0; i < grid.size(); ++i) {
+		const smart_gamma::SmartGammaSettings &settings = grid[i].settings;
+		const Metrics &metrics = results[i];
+		std::fprintf(out, "%s,%g,%g,%g,%g,%llu,%llu,%.1f,%llu,%.3f,%.4f,%.4f\n",
+			     smart_gamma::IsAutoBrightnessMode(settings) ? "auto" : "threshold",
+			     settings.darkness_threshold * 100.0f, settings.threshold_duration_ms, settings.fade_in_ms,
+			     settings.fade_out_ms, static_cast<unsigned long long>(metrics.toggles),
+			     static_cast<unsigned long long>(metrics.engagements), metrics.time_to_full_ms,
+			     static_cast<unsigned long long>(metrics.reversals), metrics.oscillation_per_min,
+			     metrics.active_fraction, metrics.mean_strength);
+	}
+	if (out != stdout)
+		std::fclose(out);
+
+	const double footage_seconds = samples.back().seconds;
+	const double simulated_seconds = footage_seconds * static_cast<double>(grid.size());
+	std::fprintf(stderr, "%zu configurations x %.1f s of footage on %u threads in %.3f s (%.0fx real time)\n",
+		     grid.size(), footage_seconds, threads, wall_seconds,
+		     simulated_seconds / std::max(wall_seconds, 1e-9));
+	return 0;
+}
@@ -0,0 +1,90 @@
+// Exports Smart Gamma luminance trace files (*.sgtrace) as CSV.
+//
+// Usage: smart-gamma-trace-export <trace-file>... > trace.csv
+//
+// Rotated files may be passed in any order; records are emitted ordered by file sequence. `seconds` counts from the
+// first exported record; `wall_clock_utc` is absolute, from each file's clock pair, so it stays correct after rotation.
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "trace-reader.hpp"
+
+namespace {
+
+// RFC 4180: fields containing a separator, quote or line break are quoted, with embedded quotes doubled. Source names
+// are user-chosen in OBS and may contain any of them.
+std::string CsvField(const char *value)
+{
+	if (std::strpbrk(value, ",\"\r\n") == nullptr)
+		return value;
+
+	std::string field = "\"";
+	for (const char *c = value; *c != '\0'; ++c) {
+		if (*c == '"')
+			field += '"';
+		field += *c;
+	}
+	field += '"';
+	return field;
+}
+
+// ISO 8601 UTC with milliseconds. Records are on the monotonic clock; the file header pairs it with the wall clock.
+std::string WallClockField(const smart_gamma::TraceFileHeader &header, uint64_t timestamp_ns)
+{
+	const auto offset_ms = static_cast<int64_t>(timestamp_ns - header.created_monotonic_ns) / 1000000;
+	const int64_t unix_ms = static_cast<int64_t>(header.created_unix_ms) + offset_ms;
+	const auto seconds = static_cast<std::time_t>(unix_ms / 1000);
+	const std::tm *utc = std::gmtime(&seconds);
+	if (!utc)
+		return {};
+
+	char date[32];
+	std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", utc);
+	char field[48];
+	std::snprintf(field, sizeof(field), "%s.%03dZ", date, static_cast<int>(unix_ms % 1000));
+	return field;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		std::fprintf(stderr, "usage: %s <trace-file>...\n", argv[0]);
+		return 2;
+	}
+
+	std::vector<smart_gamma_tools::TraceFile> traces;
+	for (int i = 1; i < argc; ++i) {
+		smart_gamma_tools::TraceFile trace;
+		if (!smart_gamma_tools::ReadTraceFile(argv[i], trace))
+			return 1;
+		traces.push_back(std::move(trace));
+	}
+	smart_gamma_tools::SortTraceFiles(traces);
+
+	std::printf("timestamp_ns,seconds,wall_clock_utc,source,raw_luminance,smoothed_luminance,state,effect_strength,"
+		    "probe_cost_us,probe_size,mode\n");
+
+	uint64_t first_timestamp = 0;
+	for (const smart_gamma_tools::TraceFile &trace : traces) {
+		const std::string source = CsvField(trace.header.source_name);
+		for (const smart_gamma::TraceRecord &record : trace.records) {
+			if (first_timestamp == 0)
+				first_timestamp = record.timestamp_ns;
+			const double seconds = static_cast<double>(record.timestamp_ns - first_timestamp) / 1e9;
+			const std::string wall_clock = WallClockField(trace.header, record.timestamp_ns);
+			std::printf("%" PRIu64 ",%.6f,%s,%s,%.6f,%.6f,%s,%.6f,%.3f,%u,%s\n", record.timestamp_ns,
+				    seconds, wall_clock.c_str(), source.c_str(), record.raw_luminance,
+				    record.smoothed_luminance, smart_gamma::TraceStateName(record.state),
+				    record.effect_strength, static_cast<double>(record.probe_cost_ns) / 1000.0,
+				    static_cast<unsigned>(record.probe_size), record.mode ? "threshold" : "auto");
+		}
+	}
+	return 0;
+}
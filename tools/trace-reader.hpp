@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "smart-gamma/trace_format.hpp"
+
+// Loads .sgtrace files for the command-line tools. Rotated files may be passed in any order.
+
+namespace smart_gamma_tools {
+
+struct TraceFile {
+	std::string path;
+	smart_gamma::TraceFileHeader header{};
+	std::vector<smart_gamma::TraceRecord> records;
+};
+
+inline bool ReadTraceFile(const char *path, TraceFile &trace)
+{
+	FILE *file = std::fopen(path, "rb");
+	if (!file) {
+		std::fprintf(stderr, "cannot open %s\n", path);
+		return false;
+	}
+
+	bool ok = std::fread(&trace.header, sizeof(trace.header), 1, file) == 1 &&
+		  smart_gamma::IsValidTraceHeader(trace.header);
+	if (ok) {
+		// The name is printed as a C string; never trust the file to terminate it.
+		trace.header.source_name[sizeof(trace.header.source_name) - 1] = '\0';
+		trace.path = path;
+		trace.records.resize(static_cast<std::size_t>(trace.header.record_count));
+		ok = trace.records.empty() || std::fread(trace.records.data(), sizeof(smart_gamma::TraceRecord),
+							 trace.records.size(), file) == trace.records.size();
+	}
+	std::fclose(file);
+
+	if (!ok)
+		std::fprintf(stderr, "%s is not a valid trace file\n", path);
+	return ok;
+}
+
+inline void SortTraceFiles(std::vector<TraceFile> &traces)
+{
+	std::sort(traces.begin(), traces.end(), [](const TraceFile &a, const TraceFile &b) {
+		return a.header.file_sequence < b.header.file_sequence;
+	});
+}
+
+} // namespace smart_gamma_tools